@@ -16,30 +16,137 @@
 *  along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
+#include <cstring>
+
 #include "Nes_Apu.h"
 #include "Blip_Buffer.h"
 
 #include "blargg_apu.h"
 #include "constants.h"
 
-static Nes_Apu apus[2];
-static Blip_Buffer bufs[2];
+// The game thread runs the sound engine, which doesn't touch the APUs
+// directly. Instead, everything it does gets put in a queue along with the APU
+// clock time it happened at, and the audio thread applies it to the APUs when
+// it needs more samples. The queue has a single producer and consumer, so the
+// two atomic indices are all the synchronization needed.
+enum {
+    EVENT_WRITE,
+    EVENT_END_FRAME,
+    EVENT_CLEAR,
+    EVENT_VOLUME,
+    EVENT_APU_VOLUME,
+    EVENT_RATE,
+    EVENT_MUTE,
+    EVENT_APU_COUNT,
+};
+
+struct ApuEvent {
+    Uint8 type;
+    Uint8 num;
+    Uint8 data;
+    Uint16 addr;
+    blip_time_t time;
+    double value;
+};
+
+#define EVENT_QUEUE_SIZE 4096
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+static ApuEvent events[EVENT_QUEUE_SIZE];
+static std::atomic<unsigned> eventRead(0);
+static std::atomic<unsigned> eventWrite(0);
+// frames that have been queued but not synthesized yet
+static std::atomic<int> queuedFrames(0);
+// samples that have been synthesized but not read yet
+static std::atomic<int> bufferedSamples(0);
+static int samplesPerFrame;
+
+// only touched by the game thread
 static blip_time_t clock_time;
+// Last value written to each register, -1 if unknown. Writes that wouldn't
+// change anything don't get queued, which saves the audio thread from having
+// to run the APU up to their time.
+#define NUM_REGS 0x18
+static Sint16 shadowRegs[2][NUM_REGS];
+static Uint32 totalWrites;
+static Uint32 skippedWrites;
+// While muted, writes only go to the shadow registers and nothing gets queued
+// for the audio thread to synthesize. Unmuting writes the shadow registers to
+// the APUs to bring them back up to date.
+static int gameMuted = 0;
+static int gameApuCount = 1;
+
+// only touched by the audio thread
+// Both APUs output into the same buffer, so their waveforms get mixed when
+// the band-limited steps are added instead of after the samples are read out.
+// Each Nes_Apu has its own synths, so their volumes can still be set separately.
+static Nes_Apu apus[2];
+static Blip_Buffer buf;
+// each APU's volume is the master volume scaled by its own
+static double masterVolume = 1.0;
+static double apuVolumes[2] = {1.0, 1.0};
+static int apuCount = 1;
 static blip_time_t frame_length = 29780;
+static int muted = 0;
+#define CLOCK_RATE 1789773
+
+static int Blargg_Apu_Push(ApuEvent &event) {
+    unsigned write = eventWrite.load(std::memory_order_relaxed);
+    if ((write - eventRead.load(std::memory_order_acquire)) >= EVENT_QUEUE_SIZE) {
+        // the audio thread isn't keeping up, nothing can be done but drop it
+        return 0;
+    }
+    events[write & EVENT_QUEUE_MASK] = event;
+    eventWrite.store(write + 1, std::memory_order_release);
+    return 1;
+}
+
+static void Blargg_Apu_PushValue(Uint8 type, double value) {
+    ApuEvent event = {};
+    event.type = type;
+    event.time = clock_time;
+    event.value = value;
+    Blargg_Apu_Push(event);
+}
 
 void Blargg_Apu_Init(Uint32 sampleRate) {
-    bufs[0].clock_rate(1789773);
-    bufs[0].sample_rate(sampleRate);
-    bufs[1].clock_rate(1789773);
-    bufs[1].sample_rate(sampleRate);
+    buf.clock_rate(CLOCK_RATE);
+    buf.sample_rate(sampleRate);
+    samplesPerFrame = (int)(sampleRate / 60);
+    for (int apu = 0; apu < 2; apu++) {
+        for (int reg = 0; reg < NUM_REGS; reg++) {
+            shadowRegs[apu][reg] = -1;
+        }
+    }
 
-    apus[0].output(&bufs[0]);
-    apus[1].output(&bufs[1]);
+    apus[0].output(&buf);
+    apus[1].output(&buf);
 }
 
 void Blargg_Apu_Volume(int volume) {
-    apus[0].volume((double)volume / 100.0);
-    apus[1].volume((double)volume / 100.0);
+    Blargg_Apu_PushValue(EVENT_VOLUME, (double)volume / 100.0);
+}
+
+void Blargg_Apu_ApuVolume(int num, int volume) {
+    ApuEvent event = {};
+    event.type = EVENT_APU_VOLUME;
+    event.num = (Uint8)num;
+    event.time = clock_time;
+    event.value = (double)volume / 100.0;
+    Blargg_Apu_Push(event);
+}
+
+void Blargg_Apu_SetRateAdjust(double adjust) {
+    Blargg_Apu_PushValue(EVENT_RATE, adjust);
+}
+
+void Blargg_Apu_SetApuCount(int count) {
+    // the second APU gets reset when it's turned off
+    for (int reg = 0; reg < NUM_REGS; reg++) {
+        shadowRegs[1][reg] = -1;
+    }
+    gameApuCount = count;
+    Blargg_Apu_PushValue(EVENT_APU_COUNT, count);
 }
 
 static blip_time_t clock_tick(void) {
@@ -47,28 +154,206 @@ static blip_time_t clock_tick(void) {
     return clock_time;
 }
 
+static int Blargg_Apu_PushWrite(int num, Uint16 addr, Uint8 data) {
+    ApuEvent event = {};
+    event.type = EVENT_WRITE;
+    event.num = (Uint8)num;
+    event.addr = addr;
+    event.data = data;
+    event.time = clock_tick();
+    return Blargg_Apu_Push(event);
+}
+
+static void Blargg_Apu_RestoreReg(int num, Uint16 addr) {
+    Sint16 *shadow = &shadowRegs[num][addr - 0x4000];
+    if ((*shadow >= 0) && !Blargg_Apu_PushWrite(num, addr, (Uint8)*shadow)) {
+        *shadow = -1;
+    }
+}
+
+// writes everything in the shadow registers to the APU, so it ends up in the
+// same state as it would've been in if it never stopped running (other than
+// notes being restarted)
+static void Blargg_Apu_Restore(int num) {
+    Blargg_Apu_RestoreReg(num, 0x4017);
+    // channels have to be enabled before their length counters get loaded
+    Blargg_Apu_RestoreReg(num, 0x4015);
+    for (Uint16 addr = 0x4000; addr <= 0x4013; addr++) {
+        Blargg_Apu_RestoreReg(num, addr);
+    }
+}
+
+void Blargg_Apu_SetMuted(int mute) {
+    mute = (mute != 0);
+    if (mute == gameMuted) { return; }
+    gameMuted = mute;
+    Blargg_Apu_PushValue(EVENT_MUTE, mute);
+    if (!mute) {
+        for (int i = 0; i < gameApuCount; i++) {
+            Blargg_Apu_Restore(i);
+        }
+    }
+}
+
 void Blargg_Apu_ClearBuffer(void) {
-    bufs[0].clear();
-    bufs[1].clear();
+    Blargg_Apu_PushValue(EVENT_CLEAR, 0);
 }
 
-Sint32 Blargg_Apu_SamplesAvailable(void) {
-    return (Sint32)bufs[0].samples_avail();
+void Blargg_Apu_GetWriteStats(Uint32 *writes, Uint32 *skipped) {
+    *writes = totalWrites;
+    *skipped = skippedWrites;
+}
+
+Sint32 Blargg_Apu_QueuedSamples(void) {
+    return (queuedFrames.load() * samplesPerFrame) + bufferedSamples.load();
+}
+
+// registers that do something besides store a value when they're written
+static bool Blargg_Apu_HasSideEffects(Uint16 addr) {
+    switch (addr) {
+    // sweep reload
+    case 0x4001:
+    case 0x4005:
+    // the sweep unit rewrites the timer registers, so the shadow copy of
+    // these can be out of date
+    case 0x4002:
+    case 0x4006:
+    // length counter load, phase/envelope/linear counter reload
+    case 0x4003:
+    case 0x4007:
+    case 0x400B:
+    case 0x400F:
+    // frame sequencer reset
+    case 0x4017:
+        return true;
+    }
+    // the game doesn't use the DMC, so it's left alone to be safe
+    return (addr >= 0x4010) && (addr <= 0x4013);
 }
 
 void Blargg_Apu_Write(int num, Uint16 addr, Uint8 data) {
-    apus[num].write_register(clock_tick(), addr, data);
+    totalWrites++;
+    Sint16 *shadow = NULL;
+    if ((addr >= 0x4000) && (addr < (0x4000 + NUM_REGS))) {
+        shadow = &shadowRegs[num][addr - 0x4000];
+        if (gameMuted) {
+            *shadow = data;
+            skippedWrites++;
+            return;
+        }
+        if ((*shadow == data) && !Blargg_Apu_HasSideEffects(addr)) {
+            skippedWrites++;
+            return;
+        }
+    }
+    else if (gameMuted) {
+        skippedWrites++;
+        return;
+    }
+
+    int pushed = Blargg_Apu_PushWrite(num, addr, data);
+    if (shadow) {
+        // if the write got dropped, we don't know what's in the register
+        *shadow = pushed ? data : -1;
+    }
 }
 
 void Blargg_Apu_EndFrame(void) {
     clock_time = 0;
-    frame_length ^= 1;
-    apus[0].end_frame(frame_length);
-    bufs[0].end_frame(frame_length);
-    apus[1].end_frame(frame_length);
-    bufs[1].end_frame(frame_length);
+    if (gameMuted) { return; }
+    ApuEvent event = {};
+    event.type = EVENT_END_FRAME;
+    if (Blargg_Apu_Push(event)) {
+        queuedFrames++;
+    }
 }
 
-Sint32 Blargg_Apu_Samples(int num, Sint16 *buff, Sint32 buffSize) {
-    return (Sint32)bufs[num].read_samples(buff, buffSize);
+// applies queued events up to the end of the next frame, returns zero if
+// there wasn't a complete frame queued
+static int Blargg_Apu_RunFrame(void) {
+    unsigned read = eventRead.load(std::memory_order_relaxed);
+    unsigned write = eventWrite.load(std::memory_order_acquire);
+    int ended = 0;
+    while ((read != write) && !ended) {
+        ApuEvent &event = events[read & EVENT_QUEUE_MASK];
+        switch (event.type) {
+        case EVENT_WRITE:
+            if (!muted && (event.num < apuCount)) {
+                apus[event.num].write_register(event.time, event.addr, event.data);
+            }
+            break;
+
+        case EVENT_END_FRAME:
+            if (!muted) {
+                frame_length ^= 1;
+                for (int i = 0; i < apuCount; i++) {
+                    apus[i].end_frame(frame_length);
+                }
+                buf.end_frame(frame_length);
+            }
+            queuedFrames--;
+            ended = 1;
+            break;
+
+        case EVENT_CLEAR:
+            buf.clear();
+            break;
+
+        case EVENT_VOLUME:
+            masterVolume = event.value;
+            apus[0].volume(masterVolume * apuVolumes[0]);
+            apus[1].volume(masterVolume * apuVolumes[1]);
+            break;
+
+        case EVENT_APU_VOLUME:
+            apuVolumes[event.num] = event.value;
+            apus[event.num].volume(masterVolume * apuVolumes[event.num]);
+            break;
+
+        case EVENT_RATE: {
+            // telling Blip_Buffer the APU runs slower makes it output more
+            // samples per APU frame
+            long rate = (long)((CLOCK_RATE / (1.0 + event.value)) + 0.5);
+            buf.clock_rate(rate);
+            break;
+        }
+
+        case EVENT_MUTE:
+            muted = (event.value != 0);
+            if (muted) {
+                // the game thread restores the registers when it unmutes
+                apus[0].reset();
+                apus[1].reset();
+                buf.clear();
+            }
+            break;
+
+        case EVENT_APU_COUNT:
+            apuCount = (int)event.value;
+            if (apuCount < 2) {
+                // make sure it's silent when it gets turned back on
+                apus[1].reset();
+            }
+            break;
+        }
+        read++;
+    }
+    eventRead.store(read, std::memory_order_release);
+    return ended;
+}
+
+int Blargg_Apu_Render(Sint16 *buff, int count) {
+    // nothing gets synthesized while muted, just skip events until unmuting
+    while (muted && Blargg_Apu_RunFrame()) { }
+    if (muted) {
+        memset(buff, 0, count * sizeof(Sint16));
+        bufferedSamples = 0;
+        return count;
+    }
+
+    while ((buf.samples_avail() < count) && Blargg_Apu_RunFrame()) { }
+    // read_samples clamps, so loud parts saturate instead of wrapping around
+    int total = (int)buf.read_samples(buff, count);
+    bufferedSamples = (int)buf.samples_avail();
+    return total;
 }
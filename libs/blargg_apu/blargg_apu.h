@@ -23,6 +23,10 @@ extern "C" {
 
 #include "constants.h"
 
+// Everything besides Blargg_Apu_Init and Blargg_Apu_Render gets queued up to be
+// run by the next Blargg_Apu_Render call, so those can happen on a different
+// thread than the rest (but only one thread for each side).
+
 /**
  * @brief Initializes the APU state
  * @param sampleRate hz
@@ -30,20 +34,44 @@ extern "C" {
 void Blargg_Apu_Init(Uint32 sampleRate);
 
 /**
- * @brief Sets the APU volume
+ * @brief Sets the volume of both APUs
  * @param volume percentage (0-100)
  */
 void Blargg_Apu_Volume(int volume);
 
+/**
+ * @brief Sets one APU's volume relative to the others. Both APUs are mixed
+ * into the same buffer, so this is how to balance them. Defaults to 100.
+ * @param num which APU (0 or 1)
+ * @param volume percentage of the volume set by Blargg_Apu_Volume (0-100)
+ */
+void Blargg_Apu_ApuVolume(int num, int volume);
+
+/**
+ * @brief Speeds up or slows down the sound output by a small amount, for
+ * keeping it in sync with the audio device.
+ * @param adjust fraction to change the number of samples per frame by (0.001
+ * = 0.1% more samples)
+ */
+void Blargg_Apu_SetRateAdjust(double adjust);
+
+/**
+ * @brief Silences the output. While muted, register writes are only recorded
+ * and nothing is synthesized. Unmuting brings the APUs up to date with the
+ * recorded registers.
+ * @param mute nonzero = silent, zero = audible
+ */
+void Blargg_Apu_SetMuted(int mute);
+
 /**
  * @brief Clears the APU sound buffer
  */
 void Blargg_Apu_ClearBuffer(void);
 
 /**
- * @returns Number of samples in the APU sound buffer
+ * @returns Number of samples that have been queued but not rendered yet
  */
-Sint32 Blargg_Apu_SamplesAvailable(void);
+Sint32 Blargg_Apu_QueuedSamples(void);
 
 /**
  * @brief Writes to an APU address
@@ -53,19 +81,34 @@ Sint32 Blargg_Apu_SamplesAvailable(void);
  */
 void Blargg_Apu_Write(int num, Uint16 addr, Uint8 data);
 
+/**
+ * @brief Sets how many APUs get run. Writes to an APU that isn't running are
+ * ignored, and turning off the second APU resets it.
+ * @param count 1 or 2
+ */
+void Blargg_Apu_SetApuCount(int count);
+
+/**
+ * @brief Gets how many register writes there have been. Writes that wouldn't
+ * change the APU's state are skipped.
+ * @param writes where to write the total number of writes to
+ * @param skipped where to write the number of skipped writes to
+ */
+void Blargg_Apu_GetWriteStats(Uint32 *writes, Uint32 *skipped);
+
 /**
  * @brief Should be run at the end of each frame
  */
 void Blargg_Apu_EndFrame(void);
 
 /**
- * @brief Requests to copy a number of APU samples to the given buffer
- * @param num APU to get samples from (0 or 1)
+ * @brief Synthesizes queued frames as needed and copies the output of both
+ * APUs mixed together to the given buffer
  * @param buff Pointer to sample buffer (16-bit)
- * @param buffSize Buffer size in Sint16s (not bytes)
+ * @param count Buffer size in Sint16s (not bytes)
  * @returns Number of samples actually written to the buffer
  */
-Sint32 Blargg_Apu_Samples(int num, Sint16 *buff, Sint32 buffSize);
+int Blargg_Apu_Render(Sint16 *buff, int count);
 
 #ifdef __cplusplus
 }
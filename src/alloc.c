@@ -17,13 +17,52 @@
  * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// per-thread, so worker threads loading things don't show up in the game
+// thread's counts
+static THREAD_LOCAL Uint32 frameAllocs = 0;
+static THREAD_LOCAL Uint32 unexpectedAllocs = 0;
+static THREAD_LOCAL int allowDepth = 0;
+
+// only touched by the thread calling Alloc_EndFrame
+static Uint32 frames = 0;
+static Uint32 framesWithAllocs = 0;
+static Uint32 maxFrameAllocs = 0;
+
+// each arena is only used by one thread at a time, so these don't need locking
+static AllocStats tagStats[ALLOC_NUM_TAGS];
+static const char *tagNames[ALLOC_NUM_TAGS] = {
+    "rom",
+    "map",
+    "sound",
+    "graphics",
+};
+
+static void Alloc_Count(void) {
+    frameAllocs++;
+    if (!allowDepth) {
+        unexpectedAllocs++;
+    }
+}
 
 void *ommalloc(size_t size) {
     void *ptr = malloc(size);
     if (!ptr) {
         abort();
     }
+    Alloc_Count();
     return ptr;
 }
 
@@ -32,5 +71,140 @@ void *omrealloc(void *ptr, size_t new_size) {
     if (!ptr) {
         abort();
     }
+    Alloc_Count();
+    return ptr;
+}
+
+#define ARENA_ALIGN (16)
+#define ARENA_ROUND(x) (((x) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+};
+
+// keeps the data after the header aligned
+#define BLOCK_HEADER_SIZE ARENA_ROUND(sizeof(ArenaBlock))
+#define BLOCK_DATA(block) ((Uint8 *)(block) + BLOCK_HEADER_SIZE)
+// allocations bigger than this get their own block
+#define ARENA_BIG(arena) ((arena)->blockSize / 4)
+
+static void Arena_Track(Arena *arena, size_t added, size_t removed) {
+    AllocStats *stats = &tagStats[arena->tag];
+    stats->current = stats->current + added - removed;
+    stats->peak = MAX(stats->peak, stats->current);
+}
+
+static ArenaBlock *Arena_NewBlock(size_t size) {
+    ArenaBlock *block = ommalloc(BLOCK_HEADER_SIZE + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void *Arena_Alloc(Arena *arena, size_t size) {
+    size = ARENA_ROUND(MAX(size, 1));
+    ArenaBlock *head = arena->blocks;
+    tagStats[arena->tag].count++;
+    Arena_Track(arena, size, 0);
+
+    // Big allocations get their own block behind the newest one, so whatever
+    // space is left in the newest one can still be used. This doesn't touch
+    // arena->last, which is still at the end of the newest block.
+    if (head && ((head->size - head->used) < size) && (size > ARENA_BIG(arena))) {
+        ArenaBlock *block = Arena_NewBlock(size);
+        block->used = size;
+        block->next = head->next;
+        head->next = block;
+        return BLOCK_DATA(block);
+    }
+
+    if (!head || ((head->size - head->used) < size)) {
+        head = Arena_NewBlock(MAX(arena->blockSize, size));
+        head->next = arena->blocks;
+        arena->blocks = head;
+    }
+    void *ptr = BLOCK_DATA(head) + head->used;
+    head->used += size;
+    arena->last = ptr;
     return ptr;
 }
+
+void *Arena_Realloc(Arena *arena, void *ptr, size_t oldSize, size_t newSize) {
+    if (!ptr) {
+        return Arena_Alloc(arena, newSize);
+    }
+    oldSize = ARENA_ROUND(MAX(oldSize, 1));
+    newSize = ARENA_ROUND(MAX(newSize, 1));
+    ArenaBlock *block = arena->blocks;
+    // the last allocation is always at the end of the newest block (big ones
+    // in their own blocks never count as the last allocation)
+    if ((ptr == arena->last) && ((block->size - block->used + oldSize) >= newSize)) {
+        block->used = block->used - oldSize + newSize;
+        Arena_Track(arena, newSize, oldSize);
+        return ptr;
+    }
+    void *newPtr = Arena_Alloc(arena, newSize);
+    memcpy(newPtr, ptr, MIN(oldSize, newSize));
+    return newPtr;
+}
+
+void Arena_Reset(Arena *arena) {
+    ArenaBlock *head = arena->blocks;
+    if (!head) { return; }
+    // keep the newest block around, big allocations never go in it so it's
+    // normal sized
+    size_t freed = head->used;
+    ArenaBlock *block = head->next;
+    while (block) {
+        ArenaBlock *next = block->next;
+        freed += block->used;
+        free(block);
+        block = next;
+    }
+    head->next = NULL;
+    head->used = 0;
+    arena->last = NULL;
+    Arena_Track(arena, 0, freed);
+}
+
+void Alloc_GetStats(AllocTag tag, AllocStats *out) {
+    *out = tagStats[tag];
+}
+
+Uint32 Alloc_EndFrame(void) {
+    Uint32 count = frameAllocs;
+#ifdef OM_ALLOC_CHECK
+    if (unexpectedAllocs) {
+        printf("alloc: %u heap allocations during frame %u\n", unexpectedAllocs, frames);
+    }
+    assert(!unexpectedAllocs);
+#endif
+    frames++;
+    if (count) {
+        framesWithAllocs++;
+        maxFrameAllocs = MAX(maxFrameAllocs, count);
+    }
+    frameAllocs = 0;
+    unexpectedAllocs = 0;
+    return count;
+}
+
+void Alloc_AllowBegin(void) {
+    allowDepth++;
+}
+
+void Alloc_AllowEnd(void) {
+    assert(allowDepth > 0);
+    allowDepth--;
+}
+
+void Alloc_PrintStats(void) {
+    for (int i = 0; i < ALLOC_NUM_TAGS; i++) {
+        printf("alloc: %-8s %8zu bytes (peak %zu) in %u allocations\n", tagNames[i],
+               tagStats[i].current, tagStats[i].peak, tagStats[i].count);
+    }
+    printf("alloc: %u of %u frames allocated, at most %u times\n", framesWithAllocs, frames, maxFrameAllocs);
+}
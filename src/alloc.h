@@ -19,6 +19,7 @@
 
 #pragma once
 #include <stddef.h>
+#include "constants.h"
 
 /**
  * @brief malloc wrapper that aborts on out of memory
@@ -34,3 +35,98 @@ void *ommalloc(size_t size);
  * @returns pointer to allocated memory
  */
 void *omrealloc(void *ptr, size_t new_size);
+
+// Data that's loaded once and thrown away all at once (ROM data, map data,
+// sounds, graphics) comes out of an arena instead of getting its own heap
+// allocation. Each arena has a tag that its memory usage gets reported under.
+typedef enum {
+    ALLOC_TAG_ROM,
+    ALLOC_TAG_MAP,
+    ALLOC_TAG_SOUND,
+    ALLOC_TAG_GRAPHICS,
+    ALLOC_NUM_TAGS,
+} AllocTag;
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    AllocTag tag;
+    // how much memory to get from the heap at a time (allocations bigger than
+    // a quarter of this that don't fit in the newest block get their own one)
+    size_t blockSize;
+    ArenaBlock *blocks;
+    // the most recent allocation, which can be grown in place
+    void *last;
+} Arena;
+
+#define ARENA_INIT(tag, blockSize) {(tag), (blockSize), NULL, NULL}
+
+/**
+ * @brief Allocates memory from an arena. The memory stays valid until the
+ * arena is reset.
+ * @param arena the arena to allocate from
+ * @param size allocation size
+ * @returns pointer to allocated memory
+ */
+void *Arena_Alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Resizes memory allocated from an arena. If ptr was the arena's most
+ * recent allocation and there's room, it's grown in place, otherwise the data
+ * gets copied to a new allocation.
+ * @param arena the arena ptr was allocated from
+ * @param ptr the memory to resize (can be NULL)
+ * @param oldSize the size ptr was allocated with
+ * @param newSize the size to change it to
+ * @returns pointer to allocated memory
+ */
+void *Arena_Realloc(Arena *arena, void *ptr, size_t oldSize, size_t newSize);
+
+/**
+ * @brief Frees everything allocated from an arena. The arena hangs onto one
+ * block of memory so it can be reused without going back to the heap.
+ * @param arena the arena to reset
+ */
+void Arena_Reset(Arena *arena);
+
+typedef struct {
+    // bytes currently allocated from arenas with this tag
+    size_t current;
+    // most bytes that were ever allocated at once
+    size_t peak;
+    // how many allocations were made
+    Uint32 count;
+} AllocStats;
+
+/**
+ * @brief Gets the memory usage of all arenas with the given tag
+ * @param tag the tag to get stats for
+ * @param out (out) the stats
+ */
+void Alloc_GetStats(AllocTag tag, AllocStats *out);
+
+/**
+ * @brief Marks the end of a frame for the calling thread's allocation counts.
+ * When built with OM_ALLOC_CHECK, this asserts that no heap allocations were
+ * made during the frame outside of Alloc_AllowBegin/Alloc_AllowEnd.
+ * @returns how many heap allocations the thread made during the frame
+ */
+Uint32 Alloc_EndFrame(void);
+
+/**
+ * @brief Heap allocations the calling thread makes between this and
+ * Alloc_AllowEnd are expected (loading, saving) and don't count against the
+ * per-frame check. Calls can be nested.
+ */
+void Alloc_AllowBegin(void);
+
+/**
+ * @brief Ends a block started by Alloc_AllowBegin.
+ */
+void Alloc_AllowEnd(void);
+
+/**
+ * @brief Prints the memory usage of each tag and the per-frame allocation
+ * counts to stdout.
+ */
+void Alloc_PrintStats(void);
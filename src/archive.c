@@ -0,0 +1,146 @@
+/* archive.c: Packed resource archive
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// needed for fmemopen
+#define _POSIX_C_SOURCE 200809L
+// first because it contains the OM_UNIX define
+#include "constants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "archive.h"
+#include "file.h"
+#include "lz4.h"
+#include "util.h"
+
+static Uint8 *archiveData = NULL;
+static uint64_t archiveTime = 0;
+static Uint32 numEntries = 0;
+
+int Archive_Init(FILE *fp) {
+    Uint32 size = 0;
+    uint64_t mtime = 0;
+    File_GetInfo(fp, &size, &mtime);
+    // the archive stays loaded for as long as the game's running
+    Uint8 *data = File_Map(fp, &size);
+    int mapped = (data != NULL);
+    if (!mapped) {
+        int loadedSize;
+        data = File_Load(fp, &loadedSize);
+        size = (Uint32)loadedSize;
+    }
+    fclose(fp);
+
+    int ok = (size >= ARCHIVE_HEADER_SIZE) &&
+             (memcmp(data, ARCHIVE_MAGIC, 4) == 0) &&
+             (Util_LoadUint32(data + 4) == ARCHIVE_VERSION);
+    Uint32 count = ok ? Util_LoadUint32(data + 8) : 0;
+    if (ok && (count > ((size - ARCHIVE_HEADER_SIZE) / ARCHIVE_ENTRY_SIZE))) { ok = 0; }
+    // make sure every entry points inside the file
+    for (Uint32 i = 0; ok && (i < count); i++) {
+        Uint8 *entry = data + ARCHIVE_HEADER_SIZE + (i * ARCHIVE_ENTRY_SIZE);
+        Uint32 nameOffset = Util_LoadUint32(entry);
+        Uint32 dataOffset = Util_LoadUint32(entry + 4);
+        Uint32 storedSize = Util_LoadUint32(entry + 8);
+        if ((nameOffset >= size) || !memchr(data + nameOffset, '\0', size - nameOffset) ||
+            (dataOffset > size) || (storedSize > (size - dataOffset))) {
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        if (mapped) {
+            File_Unmap(data, size);
+        }
+        else {
+            free(data);
+        }
+        return 0;
+    }
+
+    archiveData = data;
+    archiveTime = mtime;
+    numEntries = count;
+    return 1;
+}
+
+static int Archive_Compare(const void *key, const void *entry) {
+    Uint32 nameOffset = Util_LoadUint32((Uint8 *)entry);
+    return strcmp((const char *)key, (const char *)(archiveData + nameOffset));
+}
+
+// puts data in a FILE that reads from memory
+static FILE *Archive_MemoryFile(Uint8 *data, Uint32 size, int copy) {
+#ifdef OM_UNIX
+    // fmemopen can't open an empty buffer
+    if (!size) { return tmpfile(); }
+    // this reads straight out of the mapped archive, no copying
+    if (!copy) { return fmemopen(data, size, "rb"); }
+    // With no buffer, fmemopen allocates one and frees it when the file's
+    // closed. The extra byte is for the NUL that gets written after the data.
+    FILE *fp = fmemopen(NULL, size + 1, "w+b");
+#else
+    (void)copy;
+    FILE *fp = tmpfile();
+#endif
+    if (!fp) { return NULL; }
+    if (fwrite(data, 1, size, fp) != size) {
+        fclose(fp);
+        return NULL;
+    }
+    rewind(fp);
+    return fp;
+}
+
+FILE *Archive_Open(const char *name) {
+    if (!archiveData) { return NULL; }
+    Uint8 *entry = bsearch(name, archiveData + ARCHIVE_HEADER_SIZE, numEntries, ARCHIVE_ENTRY_SIZE, Archive_Compare);
+    if (!entry) { return NULL; }
+    Uint8 *data = archiveData + Util_LoadUint32(entry + 4);
+    Uint32 storedSize = Util_LoadUint32(entry + 8);
+    Uint32 size = Util_LoadUint32(entry + 12);
+    Uint32 flags = Util_LoadUint32(entry + 16);
+
+    if (!(flags & ARCHIVE_FLAG_LZ4)) {
+        if (storedSize != size) { return NULL; }
+        return Archive_MemoryFile(data, size, 0);
+    }
+    Uint8 *decompressed = ommalloc(size ? size : 1);
+    FILE *fp = NULL;
+    if (Lz4_Decompress(data, (int)storedSize, decompressed, (int)size)) {
+        fp = Archive_MemoryFile(decompressed, size, 1);
+    }
+    free(decompressed);
+    return fp;
+}
+
+Uint32 Archive_NumEntries(void) {
+    return numEntries;
+}
+
+const char *Archive_GetName(Uint32 index) {
+    Uint8 *entry = archiveData + ARCHIVE_HEADER_SIZE + (index * ARCHIVE_ENTRY_SIZE);
+    return (const char *)(archiveData + Util_LoadUint32(entry));
+}
+
+uint64_t Archive_GetTime(void) {
+    return archiveTime;
+}
@@ -0,0 +1,75 @@
+/* archive.h: Packed resource archive
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdio.h>
+#include "constants.h"
+
+// archive file spec (everything's big endian)
+// char[4]: "OMPK"
+// Uint32: version
+// Uint32: number of entries
+// each entry, sorted by name:
+// Uint32: name offset from the start of the file (NUL terminated, uses '/'
+//         to separate directories)
+// Uint32: data offset from the start of the file (16 byte aligned)
+// Uint32: stored size
+// Uint32: original size
+// Uint32: flags
+#define ARCHIVE_FILENAME "openmadoola.pak"
+#define ARCHIVE_MAGIC "OMPK"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 12
+#define ARCHIVE_ENTRY_SIZE 20
+#define ARCHIVE_ALIGN 16
+// the entry is an LZ4 block
+#define ARCHIVE_FLAG_LZ4 (1 << 0)
+
+/**
+ * @brief Loads the archive's index. The archive gets mapped into memory if
+ * possible so uncompressed entries can be read in place.
+ * @param fp the archive file (gets closed by this function)
+ * @returns zero if the file isn't a valid archive
+ */
+int Archive_Init(FILE *fp);
+
+/**
+ * @brief Opens a file from the archive for reading
+ * @param name the file's name, e.g. "mml/mus_title.mml"
+ * @returns the file pointer, or NULL if it isn't in the archive
+ */
+FILE *Archive_Open(const char *name);
+
+/**
+ * @returns the number of files in the archive (zero if there's no archive)
+ */
+Uint32 Archive_NumEntries(void);
+
+/**
+ * @brief Gets the name of one of the files in the archive
+ * @param index which file, from 0 to Archive_NumEntries() - 1
+ * @returns the file's name, e.g. "mml/mus_title.mml"
+ */
+const char *Archive_GetName(Uint32 index);
+
+/**
+ * @returns the archive's modification time, which is used as the modification
+ * time of every file in it
+ */
+uint64_t Archive_GetTime(void);
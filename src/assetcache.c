@@ -0,0 +1,192 @@
+/* assetcache.c: Cache of data built from the ROM at startup
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// cache file spec (everything's big endian)
+// char[4]: "OMAC"
+// Uint32: version
+// Uint32: FNV-1a hash of everything after this field
+// Uint32: number of input files
+// each input file (ROM sources, then the font):
+// Uint32: size (0 if it's missing)
+// Uint32: modification time (high 32 bits)
+// Uint32: modification time (low 32 bits)
+// each section:
+// Uint32: offset from the start of the file
+// Uint32: size
+// then the section data, each section starting on a 16 byte boundary
+
+#include <stdio.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "assetcache.h"
+#include "buffer.h"
+#include "constants.h"
+#include "file.h"
+#include "graphics.h"
+#include "rom.h"
+#include "util.h"
+#include "writer.h"
+
+#define CACHE_FILENAME "assets.cache"
+#define CACHE_MAGIC "OMAC"
+#define CACHE_VERSION 1
+// where the hashed part of the file starts
+#define CACHE_HASH_START 12
+#define CACHE_ALIGN 16
+
+enum {
+    SECTION_PRG,
+    SECTION_CHR,
+    SECTION_CHR_DATA,
+    NUM_SECTIONS,
+};
+
+// every ROM source plus the font
+#define MAX_INPUTS 8
+static int numInputs;
+static Uint32 inputSizes[MAX_INPUTS];
+static uint64_t inputTimes[MAX_INPUTS];
+
+static void AssetCache_GetInputs(void) {
+    numInputs = 0;
+    for (int i = 0; i < Rom_NumSources(); i++) {
+        Rom_GetSourceInfo(i, &inputSizes[numInputs], &inputTimes[numInputs]);
+        numInputs++;
+    }
+    inputSizes[numInputs] = 0;
+    inputTimes[numInputs] = 0;
+    FILE *fp = File_OpenResource(FONT_FILENAME, "rb");
+    if (fp) {
+        File_GetInfo(fp, &inputSizes[numInputs], &inputTimes[numInputs]);
+        fclose(fp);
+    }
+    numInputs++;
+}
+
+static Uint32 AssetCache_Hash(const Uint8 *data, Uint32 size) {
+    Uint32 hash = 2166136261u;
+    for (Uint32 i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int AssetCache_Check(Uint8 *cache, Uint32 size, Uint32 *offsets, Uint32 *sizes) {
+    Uint32 headerSize = 16 + (numInputs * 12) + (NUM_SECTIONS * 8);
+    if (size < headerSize) { return 0; }
+    if (memcmp(cache, CACHE_MAGIC, 4) != 0) { return 0; }
+    if (Util_LoadUint32(cache + 4) != CACHE_VERSION) { return 0; }
+    if (Util_LoadUint32(cache + 12) != (Uint32)numInputs) { return 0; }
+    // rebuild if any of the input files changed
+    Uint8 *cursor = cache + 16;
+    for (int i = 0; i < numInputs; i++) {
+        if ((Util_LoadUint32(cursor) != inputSizes[i]) ||
+            (Util_LoadUint32(cursor + 4) != (Uint32)(inputTimes[i] >> 32)) ||
+            (Util_LoadUint32(cursor + 8) != (Uint32)inputTimes[i])) {
+            return 0;
+        }
+        cursor += 12;
+    }
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        offsets[i] = Util_LoadUint32(cursor);
+        sizes[i] = Util_LoadUint32(cursor + 4);
+        cursor += 8;
+        if ((offsets[i] < headerSize) || (offsets[i] > size) || (sizes[i] > (size - offsets[i]))) {
+            return 0;
+        }
+    }
+    if (sizes[SECTION_PRG] != PRG_ROM_SIZE) { return 0; }
+    if (sizes[SECTION_CHR_DATA] != (sizes[SECTION_CHR] * 4)) { return 0; }
+    // catch truncated or corrupted files
+    return Util_LoadUint32(cache + 8) == AssetCache_Hash(cache + CACHE_HASH_START, size - CACHE_HASH_START);
+}
+
+int AssetCache_Load(void) {
+    AssetCache_GetInputs();
+    FILE *fp = File_Open(CACHE_FILENAME, "rb");
+    if (!fp) { return 0; }
+    Uint32 size = 0;
+    Uint8 *cache = File_Map(fp, &size);
+    int mapped = (cache != NULL);
+    if (!mapped) {
+        int loadedSize;
+        cache = File_Load(fp, &loadedSize);
+        size = (Uint32)loadedSize;
+    }
+    fclose(fp);
+
+    Uint32 offsets[NUM_SECTIONS];
+    Uint32 sizes[NUM_SECTIONS];
+    if (!AssetCache_Check(cache, size, offsets, sizes)) {
+        if (mapped) {
+            File_Unmap(cache, size);
+        }
+        else {
+            free(cache);
+        }
+        return 0;
+    }
+
+    // the cache stays loaded for as long as the game's running
+    memcpy(prgRom, cache + offsets[SECTION_PRG], PRG_ROM_SIZE);
+    chrRom = cache + offsets[SECTION_CHR];
+    chrRomSize = (int)sizes[SECTION_CHR];
+    Graphics_SetChrData(cache + offsets[SECTION_CHR_DATA]);
+    return 1;
+}
+
+static void AssetCache_Align(Buffer *buf) {
+    while (buf->dataSize % CACHE_ALIGN) {
+        Buffer_Add(buf, 0);
+    }
+}
+
+void AssetCache_Save(void) {
+    Uint8 *sectionData[NUM_SECTIONS] = {prgRom, chrRom, Graphics_GetChrData()};
+    Uint32 sectionSizes[NUM_SECTIONS] = {PRG_ROM_SIZE, (Uint32)chrRomSize, (Uint32)chrRomSize * 4};
+    if (!sectionData[SECTION_CHR_DATA]) { return; }
+
+    Buffer *buf = Buffer_Init(PRG_ROM_SIZE + (chrRomSize * 5) + 256);
+    Buffer_AddData(buf, (Uint8 *)CACHE_MAGIC, 4);
+    Buffer_AddUint32(buf, CACHE_VERSION);
+    // filled in once everything's been written
+    Buffer_AddUint32(buf, 0);
+    Buffer_AddUint32(buf, (Uint32)numInputs);
+    for (int i = 0; i < numInputs; i++) {
+        Buffer_AddUint32(buf, inputSizes[i]);
+        Buffer_AddUint32(buf, (Uint32)(inputTimes[i] >> 32));
+        Buffer_AddUint32(buf, (Uint32)inputTimes[i]);
+    }
+    int sectionTable = buf->dataSize;
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        Buffer_AddUint32(buf, 0);
+        Buffer_AddUint32(buf, sectionSizes[i]);
+    }
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        AssetCache_Align(buf);
+        Util_SaveUint32((Uint32)buf->dataSize, buf->data + sectionTable + (i * 8));
+        Buffer_AddData(buf, sectionData[i], (int)sectionSizes[i]);
+    }
+    Util_SaveUint32(AssetCache_Hash(buf->data + CACHE_HASH_START, buf->dataSize - CACHE_HASH_START), buf->data + 8);
+
+    Writer_Write(CACHE_FILENAME, buf->data, buf->dataSize);
+    Buffer_Destroy(buf);
+}
@@ -0,0 +1,36 @@
+/* assetcache.h: Cache of data built from the ROM at startup
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+
+/**
+ * @brief Loads PRG ROM, CHR ROM (with the font) and the converted CHR data
+ * from the cache file, if it's there and none of the files it was built from
+ * have changed. The cache is mapped into memory and used in place, so chrRom
+ * is read-only afterwards and Rom_LoadChr can't be used.
+ * @returns 1 if everything got loaded, 0 if it has to be built normally
+ */
+int AssetCache_Load(void);
+
+/**
+ * @brief Writes the cache file. Should be run once Rom_Load, Rom_LoadChr and
+ * Graphics_Init have been run, if AssetCache_Load failed.
+ */
+void AssetCache_Save(void);
@@ -24,6 +24,7 @@
 #include "graphics.h"
 #include "map.h"
 #include "palette.h"
+#include "state.h"
 
 #define TEXT_BASE (0x800) // font characters are stored in bank 7
 
@@ -35,6 +36,12 @@ typedef struct {
 static BgTile bgTiles[BG_HEIGHT][BG_WIDTH];
 static Uint32 xScroll, yScroll;
 
+void BG_RegisterState(void) {
+    State_Register(bgTiles, sizeof(bgTiles), 0);
+    State_Register(&xScroll, sizeof(xScroll), 0);
+    State_Register(&yScroll, sizeof(yScroll), 0);
+}
+
 void BG_Fill(Uint16 tile, Uint8 palnum) {
     for (int y = 0; y < BG_HEIGHT; y++) {
         for (int x = 0; x < BG_WIDTH; x++) {
@@ -114,3 +114,8 @@ void BG_Scroll(Uint32 x, Uint32 y);
  * @brief Draws the background to the screen. Should be run once per frame
 */
 void BG_Display(void);
+
+/**
+ * @brief Adds the background tiles and scroll position to the game state.
+*/
+void BG_RegisterState(void);
@@ -17,6 +17,7 @@
  * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -26,6 +27,7 @@
 #include "file.h"
 #include "platform.h"
 #include "util.h"
+#include "writer.h"
 
 Buffer *Buffer_Init(int allocSize) {
     if (allocSize <= 0) { return NULL; }
@@ -33,6 +35,7 @@ Buffer *Buffer_Init(int allocSize) {
     buf->allocSize = allocSize;
     buf->dataSize = 0;
     buf->data = ommalloc(allocSize);
+    buf->mapped = 0;
     return buf;
 }
 
@@ -40,40 +43,78 @@ Buffer *Buffer_InitFromFile(FILE *fp) {
     fseek(fp, 0, SEEK_END);
     int size = ftell(fp);
     rewind(fp);
-    Buffer *buf = Buffer_Init(size);
+    // an empty file still needs a valid buffer
+    Buffer *buf = Buffer_Init(MAX(size, 1));
     Buffer_AddFromFile(buf, fp, size);
     return buf;
 }
 
+Buffer *Buffer_InitMapped(FILE *fp) {
+    Uint32 size;
+    Uint8 *data = File_Map(fp, &size);
+    // files in the resource archive (or on platforms without mapping) get read in
+    if (!data) {
+        return Buffer_InitFromFile(fp);
+    }
+    Buffer *buf = ommalloc(sizeof(Buffer));
+    buf->allocSize = (int)size;
+    buf->dataSize = (int)size;
+    buf->data = data;
+    buf->mapped = 1;
+    return buf;
+}
+
 Buffer *Buffer_InitFromString(char *str) {
     int strSize = (int)strlen(str) + 1;
     Buffer *buf = Buffer_Init(strSize);
-    while (*str) {
-        Buffer_Add(buf, *str);
-        str++;
-    }
-    Buffer_Add(buf, 0);
+    Buffer_AddData(buf, (Uint8 *)str, strSize);
     return buf;
 }
 
 void Buffer_Destroy(Buffer *buf) {
-    free(buf->data);
+    if (buf->mapped) {
+        File_Unmap(buf->data, (Uint32)buf->allocSize);
+    }
+    else {
+        free(buf->data);
+    }
     free(buf);
 }
 
-void Buffer_Add(Buffer *buf, Uint8 data) {
-    buf->data[buf->dataSize] = data;
-    buf->dataSize++;
-    if (buf->dataSize >= buf->allocSize) {
-        buf->allocSize *= 2;
+void Buffer_Reserve(Buffer *buf, int len) {
+    assert(!buf->mapped);
+    int needed = buf->dataSize + len;
+    if (needed > buf->allocSize) {
+        // grow geometrically so lots of small adds don't keep reallocating
+        int allocSize = MAX(buf->allocSize, 1);
+        while (needed > allocSize) {
+            allocSize *= 2;
+        }
+        buf->allocSize = allocSize;
         buf->data = omrealloc(buf->data, buf->allocSize);
     }
 }
 
-void Buffer_AddData(Buffer *buf, Uint8 *data, int len) {
-    for (int i = 0; i < len; i++) {
-        Buffer_Add(buf, data[i]);
+void Buffer_Resize(Buffer *buf, int size) {
+    if (size > buf->dataSize) {
+        Buffer_Reserve(buf, size - buf->dataSize);
+        memset(buf->data + buf->dataSize, 0, size - buf->dataSize);
+    }
+    buf->dataSize = size;
+}
+
+void Buffer_Add(Buffer *buf, Uint8 data) {
+    if (buf->dataSize >= buf->allocSize) {
+        Buffer_Reserve(buf, 1);
     }
+    buf->data[buf->dataSize++] = data;
+}
+
+void Buffer_AddData(Buffer *buf, const Uint8 *data, int len) {
+    if (len <= 0) { return; }
+    Buffer_Reserve(buf, len);
+    memcpy(buf->data + buf->dataSize, data, len);
+    buf->dataSize += len;
 }
 
 void Buffer_AddUint16(Buffer *buf, Uint16 data) {
@@ -105,14 +146,10 @@ Uint32 Buffer_ReadUint32(Buffer *buf, int index) {
 }
 
 void Buffer_AddFromFile(Buffer *buf, FILE *fp, int size) {
-    int count = 0;
-
-    while (count < size) {
-        int data = fgetc(fp);
-        if (data == EOF) { return; }
-        Buffer_Add(buf, (Uint8)data);
-        count++;
-    }
+    if (size <= 0) { return; }
+    Buffer_Reserve(buf, size);
+    // stops early if the file is shorter than expected
+    buf->dataSize += (int)fread(buf->data + buf->dataSize, 1, size, fp);
 }
 
 void Buffer_AddFile(Buffer *buf, FILE *fp) {
@@ -123,18 +160,9 @@ void Buffer_AddFile(Buffer *buf, FILE *fp) {
 }
 
 void Buffer_WriteToFile(Buffer *buf, char *filename) {
-    FILE *fp = File_Open(filename, "wb");
-    if (fp) {
-        fwrite(buf->data, 1, buf->dataSize, fp);
-        fclose(fp);
-    }
-    else {
-        Platform_ShowError("Couldn't open %s for writing.", filename);
-    }
+    Writer_Write(filename, buf->data, buf->dataSize);
 }
 
 void Buffer_Append(Buffer *dst, Buffer *src) {
-    for (int i = 0; i < src->dataSize; i++) {
-        Buffer_Add(dst, src->data[i]);
-    }
+    Buffer_AddData(dst, src->data, src->dataSize);
 }
\ No newline at end of file
@@ -25,6 +25,8 @@ typedef struct {
     int allocSize;
     int dataSize;
     Uint8 *data;
+    // nonzero if data is a read-only file mapping (see Buffer_InitMapped)
+    int mapped;
 } Buffer;
 
 /**
@@ -43,6 +45,15 @@ Buffer *Buffer_Init(int allocSize);
  */
 Buffer *Buffer_InitFromFile(FILE *fp);
 
+/**
+ * @brief Creates a read-only buffer holding the contents of the provided file.
+ * If possible, the file gets mapped into memory instead of copied. Nothing can
+ * be added to the buffer. The file can be closed once this returns.
+ * @param fp File to load from
+ * @returns pointer to new buffer
+ */
+Buffer *Buffer_InitMapped(FILE *fp);
+
 /**
  * @brief Creates a new buffer holding the contents of the provided string.
  * @param str String to load from
@@ -56,6 +67,21 @@ Buffer *Buffer_InitFromString(char *str);
  */
 void Buffer_Destroy(Buffer *buf);
 
+/**
+ * @brief Makes sure a buffer has room for more data without reallocating
+ * @param buf buffer to grow
+ * @param len how many more bytes will be added to the buffer
+ */
+void Buffer_Reserve(Buffer *buf, int len);
+
+/**
+ * @brief Changes the amount of data in a buffer. If the buffer grows, the new
+ * bytes are set to zero.
+ * @param buf buffer to resize
+ * @param size new data size
+ */
+void Buffer_Resize(Buffer *buf, int size);
+
 /**
  * @brief Adds a byte to the end of a buffer
  * @param buf buffer to add to
@@ -69,7 +95,7 @@ void Buffer_Add(Buffer *buf, Uint8 data);
  * @param data bytes to add
  * @param len how many bytes to add
  */
-void Buffer_AddData(Buffer *buf, Uint8 *data, int len);
+void Buffer_AddData(Buffer *buf, const Uint8 *data, int len);
 
 /**
  * @brief Adds a Uint16 to the end of a buffer (big-endian format)
@@ -133,7 +159,8 @@ void Buffer_AddFromFile(Buffer *buf, FILE *fp, int size);
 void Buffer_AddFile(Buffer *buf, FILE *fp);
 
 /**
- * @brief Writes a buffer to a file
+ * @brief Writes a buffer to a file. The write happens in the background, see
+ * writer.h.
  * @param buf Buffer to write to
  * @param filename Filename to write the buffer to
  */
@@ -30,10 +30,12 @@
 #include <string.h>
 
 #include "alloc.h"
+#include "buffer.h"
 #include "constants.h"
 #include "db.h"
 #include "file.h"
 #include "platform.h"
+#include "writer.h"
 
 #define DB_FILENAME "config.db"
 
@@ -65,6 +67,8 @@ DBEntry *DB_Find(char *name) {
 }
 
 void DB_Set(char *name, Uint8 *data, Uint32 dataLen) {
+    // settings get changed from menus while the game's running
+    Alloc_AllowBegin();
     DBEntry *entry = DB_Find(name);
     if (entry) {
         entry->dataLen = dataLen;
@@ -76,6 +80,7 @@ void DB_Set(char *name, Uint8 *data, Uint32 dataLen) {
         Uint8 *dbData = DB_Add(name, dataLen);
         memcpy(dbData, data, dataLen);
     }
+    Alloc_AllowEnd();
 }
 
 void DB_Init(void) {
@@ -109,20 +114,18 @@ void DB_Init(void) {
 }
 
 void DB_Save(void) {
-    FILE *fp = File_Open(DB_FILENAME, "wb");
-    if (!fp) {
-        Platform_ShowError("Couldn't open " DB_FILENAME " for writing");
-        return;
-    }
-
-    File_WriteUint32BE((Uint32)numEntries, fp);
+    Alloc_AllowBegin();
+    Buffer *buf = Buffer_Init(256);
+    Buffer_AddUint32(buf, (Uint32)numEntries);
     for (int i = 0; i < numEntries; i++) {
         // add 1 for the NUL terminator
         Uint8 nameLen = (Uint8)strlen(entries[i].name) + 1;
-        fputc(nameLen, fp);
-        fwrite(entries[i].name, 1, nameLen, fp);
-        File_WriteUint32BE(entries[i].dataLen, fp);
-        fwrite(entries[i].data, 1, entries[i].dataLen, fp);
+        Buffer_Add(buf, nameLen);
+        Buffer_AddData(buf, (Uint8 *)entries[i].name, nameLen);
+        Buffer_AddUint32(buf, entries[i].dataLen);
+        Buffer_AddData(buf, entries[i].data, (int)entries[i].dataLen);
     }
-    fclose(fp);
+    Writer_Write(DB_FILENAME, buf->data, buf->dataSize);
+    Buffer_Destroy(buf);
+    Alloc_AllowEnd();
 }
@@ -16,68 +16,221 @@
  * You should have received a copy of the GNU General Public License
  * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
  */
+#include <stdio.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "buffer.h"
 #include "constants.h"
 #include "demo.h"
 #include "file.h"
 #include "lucia.h"
+#include "platform.h"
 #include "save.h"
+#include "state.h"
 #include "task.h"
 #include "util.h"
 #include "weapon.h"
+#include "writer.h"
+
+// Version 1 format: the DemoData fields, followed by 5 byte records of a frame
+// count (number of frames - 1) and a Uint32 joypad value.
+//
+// Version 2 format: "OMDEMO", a version byte, the DemoData fields, and the
+// checkpoint interval (Uint16, 0 = no checkpoints). After that is a series of
+// records, each starting with a varint (LEB128) v:
+// - if bit 0 of v is clear, it's a run of v >> 1 frames holding the joypad
+//   value in the next byte
+// - if bit 0 of v is set, it's a record of type v >> 1, followed by a varint
+//   length and that many bytes of data. Unknown types get skipped.
+// Version 1 files can't start with "OMDEMO" because the third byte (game type)
+// would be out of range.
+//
+// Record types 1 and 2 held keyframes and a seek table in earlier builds, and
+// get skipped like any other unknown record.
+#define DEMO_MAGIC "OMDEMO"
+#define DEMO_MAGIC_LEN 6
+#define DEMO_VERSION 2
+
+// data: Uint32 State_Hash from before the frame's input is read
+#define DEMO_RECORD_HASH 0
+
+#define WRITE_BUFF_SIZE (4096)
 
 static Buffer *demoBuff = NULL;
-static Buffer *recordFilename = NULL;
 static int recording = 0;
 static int playing = 0;
-static Uint32 lastInput;
-static Uint8 frameCount;
-static int first;
+static int version;
 static int cursor;
+// number of frames recorded or played back so far
+static Uint32 frameNum;
+static Uint16 checkpointInterval;
+
+// recording
+static FILE *recordFile = NULL;
+static Uint8 writeBuff[WRITE_BUFF_SIZE];
+static int writeCursor;
+static Uint8 runInput;
+static Uint32 runLength;
 
-void Demo_Record(char *filename, DemoData *data) {
-    if (!demoBuff) {
-        demoBuff = Buffer_Init(8192);
+// version 1 playback
+static Uint8 frameCount;
+
+// version 2 playback
+static Uint32 runRemaining;
+static int desynced;
+static Uint32 totalFrames;
+
+// Snapshots taken the first time playback reaches each keyframe. They're
+// State_Save snapshots, so they only last as long as this process does.
+typedef struct {
+    Uint32 frame;
+    int cursor;
+    Uint32 runRemaining;
+    Uint8 runInput;
+    Buffer *state;
+} DemoKeyframe;
+static DemoKeyframe *keyframes = NULL;
+static int numKeyframes;
+static int keyframesAllocated = 0;
+
+static void Demo_Flush(void) {
+    if (writeCursor) {
+        fwrite(writeBuff, 1, writeCursor, recordFile);
+        writeCursor = 0;
     }
-    else {
-        demoBuff->dataSize = 0;
+}
+
+static void Demo_Write(Uint8 *data, int len) {
+    if ((writeCursor + len) > WRITE_BUFF_SIZE) {
+        Demo_Flush();
+    }
+    memcpy(writeBuff + writeCursor, data, len);
+    writeCursor += len;
+}
+
+static void Demo_WriteVarint(Uint32 num) {
+    Uint8 bytes[5];
+    int len = 0;
+    do {
+        bytes[len] = num & 0x7f;
+        num >>= 7;
+        if (num) { bytes[len] |= 0x80; }
+        len++;
+    } while (num);
+    Demo_Write(bytes, len);
+}
+
+static void Demo_WriteRun(void) {
+    if (runLength) {
+        Demo_WriteVarint(runLength << 1);
+        Demo_Write(&runInput, 1);
+        runLength = 0;
     }
-    if (recordFilename) {
-        Buffer_Destroy(recordFilename);
+}
+
+static void Demo_WriteRecord(Uint32 type, Uint8 *data, int len) {
+    Demo_WriteRun();
+    Demo_WriteVarint((type << 1) | 1);
+    Demo_WriteVarint(len);
+    Demo_Write(data, len);
+}
+
+void Demo_Record(char *filename, DemoData *data, int interval) {
+    if (recordFile) {
+        Writer_Close(recordFile);
+    }
+    recordFile = File_Open(filename, "wb");
+    if (!recordFile) {
+        Platform_ShowError("Couldn't open %s for writing.", filename);
+        return;
     }
-    recordFilename = Buffer_InitFromString(filename);
-    first = 1;
     recording = 1;
     playing = 0;
+    writeCursor = 0;
+    runLength = 0;
+    frameNum = 0;
+    checkpointInterval = (Uint16)interval;
+
     // record non-input stuff needed to play back the demo
-    Buffer_Add(demoBuff, data->rngVal);
-    Buffer_Add(demoBuff, data->gameFrames);
-    Buffer_Add(demoBuff, data->gameType);
-    Buffer_Add(demoBuff, data->stage);
-    Buffer_AddSint16(demoBuff, data->health);
-    Buffer_AddSint16(demoBuff, data->magic);
-    Buffer_Add(demoBuff, data->bootsLevel);
-    Buffer_AddData(demoBuff, data->weaponLevels, NUM_WEAPONS);
+    Uint8 header[DEMO_MAGIC_LEN + 12 + NUM_WEAPONS];
+    int len = 0;
+    memcpy(header, DEMO_MAGIC, DEMO_MAGIC_LEN);
+    len += DEMO_MAGIC_LEN;
+    header[len++] = DEMO_VERSION;
+    header[len++] = data->rngVal;
+    header[len++] = data->gameFrames;
+    header[len++] = data->gameType;
+    header[len++] = data->stage;
+    Util_SaveSint16(data->health, header + len); len += 2;
+    Util_SaveSint16(data->magic, header + len); len += 2;
+    header[len++] = data->bootsLevel;
+    memcpy(header + len, data->weaponLevels, NUM_WEAPONS);
+    len += NUM_WEAPONS;
+    Util_SaveUint16(checkpointInterval, header + len); len += 2;
+    Demo_Write(header, len);
+}
+
+static int Demo_ReadVarint(Uint32 *out) {
+    Uint32 num = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (cursor >= demoBuff->dataSize) { return 0; }
+        Uint8 byte = demoBuff->data[cursor++];
+        num |= (Uint32)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *out = num;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// the frame count isn't stored anywhere, so it has to be found by going
+// through the whole file
+static void Demo_CountFrames(void) {
+    int saved = cursor;
+    while (1) {
+        Uint32 v, len;
+        if (!Demo_ReadVarint(&v)) { break; }
+        if (v & 1) {
+            if (!Demo_ReadVarint(&len) || (len > (Uint32)(demoBuff->dataSize - cursor))) { break; }
+            cursor += len;
+        }
+        else {
+            if (cursor >= demoBuff->dataSize) { break; }
+            totalFrames += v >> 1;
+            cursor++;
+        }
+    }
+    cursor = saved;
 }
 
 int Demo_Playback(char *filename, DemoData *out) {
+    Alloc_AllowBegin();
     FILE *fp = File_OpenResource(filename, "rb");
-    if (!fp) { return 0; }
-    if (!demoBuff) {
-        demoBuff = Buffer_InitFromFile(fp);
+    if (fp) {
+        // demos are only read, so map them instead of copying them
+        if (demoBuff) {
+            Buffer_Destroy(demoBuff);
+        }
+        demoBuff = Buffer_InitMapped(fp);
         fclose(fp);
     }
-    else {
-        demoBuff->dataSize = 0;
-        Buffer_AddFile(demoBuff, fp);
-        fclose(fp);
+    Alloc_AllowEnd();
+    if (!fp) { return 0; }
+
+    cursor = 0;
+    version = 1;
+    int headerSize = 9 + NUM_WEAPONS;
+    if ((demoBuff->dataSize >= DEMO_MAGIC_LEN) && !memcmp(demoBuff->data, DEMO_MAGIC, DEMO_MAGIC_LEN)) {
+        cursor = DEMO_MAGIC_LEN;
+        version = demoBuff->data[cursor++];
+        headerSize = cursor + 11 + NUM_WEAPONS;
     }
+    if ((version > DEMO_VERSION) || (demoBuff->dataSize < headerSize)) { return 0; }
 
     playing = 1;
     recording = 0;
-    cursor = 0;
 
     out->rngVal = demoBuff->data[cursor++];
     out->gameFrames = demoBuff->data[cursor++];
@@ -88,7 +241,19 @@ int Demo_Playback(char *filename, DemoData *out) {
     out->bootsLevel = demoBuff->data[cursor++];
     memcpy(out->weaponLevels, demoBuff->data + cursor, sizeof(out->weaponLevels));
     cursor += sizeof(weaponLevels);
-    frameCount = demoBuff->data[cursor];
+    if (version == 1) {
+        frameCount = demoBuff->data[cursor];
+    }
+    else {
+        checkpointInterval = Util_LoadUint16(demoBuff->data + cursor);
+        cursor += 2;
+        runRemaining = 0;
+        frameNum = 0;
+        desynced = 0;
+        totalFrames = 0;
+        numKeyframes = 0;
+        Demo_CountFrames();
+    }
     // get first button press ready
     Task_Yield();
     return 1;
@@ -110,30 +275,111 @@ int Demo_Playing(void) {
     return playing;
 }
 
+Uint32 Demo_Frame(void) {
+    return frameNum;
+}
+
+Uint32 Demo_Length(void) {
+    return (playing && (version >= 2)) ? totalFrames : 0;
+}
+
+static void Demo_AddKeyframe(void) {
+    // keyframes are only taken every so often, so they can allocate
+    Alloc_AllowBegin();
+    if (numKeyframes == keyframesAllocated) {
+        int oldAllocated = keyframesAllocated;
+        keyframesAllocated = keyframesAllocated ? (keyframesAllocated * 2) : 64;
+        keyframes = omrealloc(keyframes, keyframesAllocated * sizeof(DemoKeyframe));
+        memset(keyframes + oldAllocated, 0, (keyframesAllocated - oldAllocated) * sizeof(DemoKeyframe));
+    }
+    DemoKeyframe *keyframe = &keyframes[numKeyframes++];
+    // buffers are kept around to be reused by the next demo
+    if (!keyframe->state) {
+        keyframe->state = Buffer_Init(65536);
+    }
+    State_Save(keyframe->state);
+    Alloc_AllowEnd();
+    keyframe->frame = frameNum;
+    keyframe->cursor = cursor;
+    keyframe->runRemaining = runRemaining;
+    keyframe->runInput = runInput;
+}
+
+void Demo_StartFrame(void) {
+    if (!playing || (version < 2)) { return; }
+    // playback only ever goes back to a keyframe, so the next one that's
+    // needed always comes after the last one taken
+    if (((frameNum % DEMO_KEYFRAME_INTERVAL) == 0) &&
+        (!numKeyframes || (frameNum > keyframes[numKeyframes - 1].frame)) && State_Init()) {
+        Demo_AddKeyframe();
+    }
+}
+
+Uint32 Demo_Seek(Uint32 target) {
+    if (!playing || (version < 2) || !numKeyframes) { return frameNum; }
+    if (target > totalFrames) { target = totalFrames; }
+
+    // the first keyframe is always frame 0
+    int index = 0;
+    for (int i = 1; (i < numKeyframes) && (keyframes[i].frame <= target); i++) {
+        index = i;
+    }
+    DemoKeyframe *keyframe = &keyframes[index];
+    // running forward from the current frame is cheaper than restoring
+    if ((frameNum <= target) && (frameNum >= keyframe->frame)) { return frameNum; }
+
+    State_Load(keyframe->state);
+    frameNum = keyframe->frame;
+    cursor = keyframe->cursor;
+    runRemaining = keyframe->runRemaining;
+    runInput = keyframe->runInput;
+    desynced = 0;
+    return frameNum;
+}
+
+static int Demo_CheckpointDue(void) {
+    return checkpointInterval && frameNum && ((frameNum % checkpointInterval) == 0);
+}
+
 void Demo_RecordInput(Uint32 input) {
     if (!recording) { return; }
 
-    if (first || (lastInput != input)) {
-        first = 0;
-        lastInput = input;
-        Buffer_Add(demoBuff, 0); // frame counter
-        Buffer_AddUint32(demoBuff, input);
+    if (Demo_CheckpointDue()) {
+        Uint8 hash[4];
+        State_Init();
+        Util_SaveUint32(State_Hash(NULL), hash);
+        Demo_WriteRecord(DEMO_RECORD_HASH, hash, sizeof(hash));
     }
-    else {
-        Uint8 *frameCountPtr = &(demoBuff->data[demoBuff->dataSize - 5]);
-        if (*frameCountPtr == 255) {
-            Buffer_Add(demoBuff, 0);
-            Buffer_AddUint32(demoBuff, lastInput);
-        }
-        else {
-            (*frameCountPtr)++;
+
+    // only the low 8 bits are used
+    Uint8 joypad = (Uint8)input;
+    if (runLength && (joypad != runInput)) {
+        Demo_WriteRun();
+    }
+    runInput = joypad;
+    runLength++;
+    frameNum++;
+}
+
+static void Demo_ReadRecord(Uint32 type) {
+    Uint32 len;
+    if (!Demo_ReadVarint(&len) || (len > (Uint32)(demoBuff->dataSize - cursor))) {
+        cursor = demoBuff->dataSize;
+        return;
+    }
+    if ((type == DEMO_RECORD_HASH) && (len == 4) && !desynced) {
+        State_Init();
+        if (Util_LoadUint32(demoBuff->data + cursor) != State_Hash(NULL)) {
+            fprintf(stderr, "Demo playback doesn't match the recording as of frame %u.\n", frameNum);
+            desynced = 1;
         }
     }
+    cursor += len;
 }
 
-Uint32 Demo_GetInput(void) {
-    if (!playing || (cursor > demoBuff->dataSize)) { return 0; }
-    
+static Uint32 Demo_GetInputV1(void) {
+    if (cursor > demoBuff->dataSize) { return 0; }
+
     Uint32 joy = Util_LoadUint32(demoBuff->data + cursor + 1);
     frameCount--;
     if (frameCount == 255) {
@@ -143,8 +389,35 @@ Uint32 Demo_GetInput(void) {
     return joy;
 }
 
+Uint32 Demo_GetInput(void) {
+    if (!playing) { return 0; }
+    if (version == 1) { return Demo_GetInputV1(); }
+
+    // records always come before the run that starts on their frame
+    while (!runRemaining) {
+        Uint32 v;
+        if (!Demo_ReadVarint(&v)) { return 0; }
+        if (v & 1) {
+            Demo_ReadRecord(v >> 1);
+        }
+        else if (cursor < demoBuff->dataSize) {
+            runRemaining = v >> 1;
+            runInput = demoBuff->data[cursor++];
+        }
+        else {
+            return 0;
+        }
+    }
+    runRemaining--;
+    frameNum++;
+    return runInput;
+}
+
 void Demo_Save(void) {
     if (!recording) { return; }
     recording = 0;
-    Buffer_WriteToFile(demoBuff, (char *)recordFilename->data);
+    Demo_WriteRun();
+    Demo_Flush();
+    Writer_Close(recordFile);
+    recordFile = NULL;
 }
@@ -31,12 +31,21 @@ typedef struct {
     Uint8 weaponLevels[NUM_WEAPONS];
 } DemoData;
 
+// how often to record a hash of the game state so playback can check that
+// it's matching the recording
+#define DEMO_CHECKPOINT_INTERVAL (60)
+// how often to take a snapshot of the game state during playback so seeking
+// backwards doesn't have to replay the whole demo
+#define DEMO_KEYFRAME_INTERVAL (60 * 10)
+
 /**
- * @brief Starts a demo recording.
+ * @brief Starts a demo recording. The demo gets written to disk as it's
+ * recorded.
  * @param filename name to save the demo file as
  * @param data game state that gets recorded
+ * @param interval how many frames between state hash checkpoints, 0 = none
  */
-void Demo_Record(char *filename, DemoData *data);
+void Demo_Record(char *filename, DemoData *data, int interval);
 
 /**
  * @brief Loads demo data and prepares to play back demo
@@ -75,6 +84,35 @@ void Demo_RecordInput(Uint32 input);
 Uint32 Demo_GetInput(void);
 
 /**
- * @brief Saves a demo recording to disk. Does nothing unless Demo_Record has previously been run.
+ * @brief Takes keyframes for Demo_Seek while playing back. Should be run at
+ * the start of every frame before anything else, including frames run while
+ * seeking.
+ */
+void Demo_StartFrame(void);
+
+/**
+ * @returns the number of frames recorded or played back so far
+ */
+Uint32 Demo_Frame(void);
+
+/**
+ * @returns the number of frames in the demo being played back, or zero if it
+ * doesn't support seeking
+ */
+Uint32 Demo_Length(void);
+
+/**
+ * @brief Restores the closest keyframe at or before the given frame. Only
+ * keyframes playback has already reached can be restored. Should be run at
+ * the start of a frame. Afterwards, run frames until Demo_Frame reaches the
+ * target.
+ * @param target the frame to seek to
+ * @returns the frame playback is at now
+ */
+Uint32 Demo_Seek(Uint32 target);
+
+/**
+ * @brief Finishes writing a demo recording to disk. Does nothing unless Demo_Record has
+ * previously been run.
  */
 void Demo_Save(void);
@@ -17,22 +17,31 @@
  * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
  */
 
+// needed for fileno
+#define _POSIX_C_SOURCE 200809L
 // first because it contains the OM_UNIX define
 #include "constants.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#ifdef OM_UNIX
 #include <sys/stat.h>
+#ifdef OM_UNIX
+#include <dirent.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef OM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
 #endif
 #include "alloc.h"
+#include "archive.h"
 #include "file.h"
 
 #ifdef OM_UNIX
 #define OM_HOMEDIR ".openmadoola"
-static int filenameBuffLen = 256;
-static char *filenameBuff = NULL;
 #endif
 
 void File_WriteUint16BE(Uint16 data, FILE *fp) {
@@ -62,74 +71,303 @@ Uint32 File_ReadUint32BE(FILE *fp) {
 }
 
 #ifdef OM_UNIX
-static void checkBuffSize(int size) {
-    if (!filenameBuff) { filenameBuff = ommalloc(filenameBuffLen); }
-    if (size > filenameBuffLen) {
-        filenameBuffLen = size;
-        filenameBuff = omrealloc(filenameBuff, filenameBuffLen);
+static const char *resourceDirs[] = {
+    "/" OM_HOMEDIR "/", // goes after the home directory
+    "/usr/local/share/openmadoola/",
+    "/usr/share/openmadoola/",
+    "", // current working directory
+};
+
+// $HOME/.openmadoola/, set up by File_Init
+static char *homePath = NULL;
+
+// Every file in the resource directories (and their subdirectories), so
+// File_OpenResource doesn't have to try each directory. Built by File_Init
+// and read-only afterwards, so it's safe to use from any thread.
+typedef struct {
+    // relative to the resource directory, e.g. "mml/mus_title.mml"
+    char *name;
+    char *path;
+    int dir;
+} ResourceEntry;
+
+static ResourceEntry *resources = NULL;
+static int numResources = 0;
+static int allocedResources = 0;
+// subdirectories that got indexed
+static char **resourceSubdirs = NULL;
+static int numResourceSubdirs = 0;
+static int resourcesIndexed = 0;
+
+static char *File_Join(const char *dir1, const char *dir2, const char *filename) {
+    char *path = ommalloc(strlen(dir1) + strlen(dir2) + strlen(filename) + 1);
+    strcpy(path, dir1);
+    strcat(path, dir2);
+    strcat(path, filename);
+    return path;
+}
+
+// Opens dir1 + dir2 + filename. The path gets allocated for each call instead
+// of being kept in a static buffer so files can be opened from multiple threads.
+static FILE *File_OpenJoined(const char *dir1, const char *dir2, const char *filename, const char *mode) {
+    char *path = File_Join(dir1, dir2, filename);
+    FILE *fp = fopen(path, mode);
+    free(path);
+    return fp;
+}
+
+static void File_AddResource(const char *subdir, const char *name, const char *path, int dir) {
+    if (numResources >= allocedResources) {
+        allocedResources = allocedResources ? (allocedResources * 2) : 64;
+        resources = omrealloc(resources, allocedResources * sizeof(ResourceEntry));
+    }
+    ResourceEntry *entry = &resources[numResources++];
+    entry->name = File_Join(subdir, subdir[0] ? "/" : "", name);
+    entry->path = File_Join(path, "", "");
+    entry->dir = dir;
+}
+
+// marks the first len characters of subdir as an indexed subdirectory
+static void File_AddSubdir(const char *subdir, size_t len) {
+    for (int i = 0; i < numResourceSubdirs; i++) {
+        if ((strlen(resourceSubdirs[i]) == len) && (strncmp(resourceSubdirs[i], subdir, len) == 0)) { return; }
     }
+    char *copy = ommalloc(len + 1);
+    memcpy(copy, subdir, len);
+    copy[len] = '\0';
+    resourceSubdirs = omrealloc(resourceSubdirs, (numResourceSubdirs + 1) * sizeof(char *));
+    resourceSubdirs[numResourceSubdirs++] = copy;
+}
+
+// adds all the files in root + subdir to the index. If subdir is "", also goes
+// one level into any subdirectories.
+static void File_IndexDir(const char *root, const char *subdir, int dir) {
+    char *dirPath = File_Join(root[0] ? root : "./", subdir, "");
+    DIR *dp = opendir(dirPath);
+    if (!dp) {
+        free(dirPath);
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dp))) {
+        // skip hidden files along with . and ..
+        if (ent->d_name[0] == '.') { continue; }
+        char *path = File_Join(dirPath, subdir[0] ? "/" : "", ent->d_name);
+        struct stat info;
+        if (stat(path, &info) == 0) {
+            if (S_ISREG(info.st_mode)) {
+                File_AddResource(subdir, ent->d_name, path, dir);
+            }
+            else if (S_ISDIR(info.st_mode) && !subdir[0]) {
+                File_IndexDir(root, ent->d_name, dir);
+                File_AddSubdir(ent->d_name, strlen(ent->d_name));
+            }
+        }
+        free(path);
+    }
+    closedir(dp);
+    free(dirPath);
+}
+
+static int File_CompareResources(const void *a, const void *b) {
+    const ResourceEntry *entryA = a;
+    const ResourceEntry *entryB = b;
+    int cmp = strcmp(entryA->name, entryB->name);
+    if (cmp) { return cmp; }
+    // earlier resource directories take priority
+    return entryA->dir - entryB->dir;
+}
+
+static int File_CompareName(const void *key, const void *entry) {
+    return strcmp((const char *)key, ((const ResourceEntry *)entry)->name);
 }
 #endif
 
-FILE *File_Open(const char *filename, const char *mode) {
+void File_Init(void) {
+#ifdef OM_UNIX
+    char *homedir = getenv("HOME");
+    if (homedir) {
+        homePath = File_Join(homedir, "/" OM_HOMEDIR "/", "");
+        // make the directory in case it doesn't exist
+        mkdir(homePath, S_IRWXU);
+    }
+    for (int i = 0; i < ARRAY_LEN(resourceDirs); i++) {
+        if (i == 0) {
+            if (homePath) { File_IndexDir(homePath, "", i); }
+        }
+        else {
+            File_IndexDir(resourceDirs[i], "", i);
+        }
+    }
+    qsort(resources, numResources, sizeof(ResourceEntry), File_CompareResources);
+    // only keep the highest priority copy of each file
+    int kept = 0;
+    for (int i = 0; i < numResources; i++) {
+        if (kept && (strcmp(resources[kept - 1].name, resources[i].name) == 0)) {
+            free(resources[i].name);
+            free(resources[i].path);
+        }
+        else {
+            resources[kept++] = resources[i];
+        }
+    }
+    numResources = kept;
+    resourcesIndexed = 1;
+#endif
+    // loose files still take priority over anything in the archive, so
+    // people can mod the game without rebuilding it
+    FILE *archive = File_OpenResource(ARCHIVE_FILENAME, "rb");
+    if (archive) {
+        Archive_Init(archive);
+    }
+#ifdef OM_UNIX
+    // Directories that only exist in the archive have to be marked as indexed
+    // too, otherwise every file in them gets looked for in each resource
+    // directory before the archive is checked.
+    for (Uint32 i = 0; i < Archive_NumEntries(); i++) {
+        const char *name = Archive_GetName(i);
+        const char *slash = strchr(name, '/');
+        // File_IsIndexed only handles one level of subdirectories
+        if (slash && !strchr(slash + 1, '/')) {
+            File_AddSubdir(name, slash - name);
+        }
+    }
+#endif
+}
+
+// gets the path File_Open uses for filename (must be freed)
+static char *File_GetPath(const char *filename) {
 #ifdef OM_UNIX
-    const char dirname[] = OM_HOMEDIR;
+    // File_Init already made the directory
+    if (homePath) {
+        return File_Join(homePath, "", filename);
+    }
     char *homedir = getenv("HOME");
     if (homedir) {
-        checkBuffSize(strlen(homedir) + 1 + strlen(dirname) + 1 + strlen(filename) + 1);
-        strcpy(filenameBuff, homedir);
-        strcat(filenameBuff, "/");
-        strcat(filenameBuff, dirname);
         // try to make the directory in case it doesn't exist
-        mkdir(filenameBuff, S_IRWXU);
-        strcat(filenameBuff, "/");
+        char *dirname = File_Join(homedir, "/" OM_HOMEDIR, "");
+        mkdir(dirname, S_IRWXU);
+        free(dirname);
         // concatenate the directory name with the requested filename
-        strcat(filenameBuff, filename);
-        return fopen(filenameBuff, mode);
+        return File_Join(homedir, "/" OM_HOMEDIR "/", filename);
     }
-    else {
-        return fopen(filename, mode);
+#endif
+    char *path = ommalloc(strlen(filename) + 1);
+    strcpy(path, filename);
+    return path;
+}
+
+FILE *File_Open(const char *filename, const char *mode) {
+    char *path = File_GetPath(filename);
+    FILE *fp = fopen(path, mode);
+    free(path);
+    return fp;
+}
+
+int File_Sync(FILE *fp) {
+    if (fflush(fp)) { return 0; }
+#if defined(OM_UNIX)
+    return fsync(fileno(fp)) == 0;
+#elif defined(OM_WINDOWS)
+    return _commit(_fileno(fp)) == 0;
+#else
+    return 1;
+#endif
+}
+
+int File_WriteAtomic(const char *filename, const Uint8 *data, int size) {
+    char *path = File_GetPath(filename);
+    char *tempPath = ommalloc(strlen(path) + sizeof(".tmp"));
+    strcpy(tempPath, path);
+    strcat(tempPath, ".tmp");
+
+    // write everything to a temp file, then swap it in so the file is never
+    // left half-written if we crash or lose power
+    int ok = 0;
+    FILE *fp = fopen(tempPath, "wb");
+    if (fp) {
+        ok = (fwrite(data, 1, size, fp) == (size_t)size);
+        ok = File_Sync(fp) && ok;
+        ok = (fclose(fp) == 0) && ok;
     }
+    if (ok) {
+#ifdef OM_WINDOWS
+        ok = MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
 #else
-    return fopen(filename, mode);
+        ok = (rename(tempPath, path) == 0);
 #endif
+    }
+    if (!ok) {
+        remove(tempPath);
+    }
+    free(tempPath);
+    free(path);
+    return ok;
+}
+
+int File_Remove(const char *filename) {
+    char *path = File_GetPath(filename);
+    int ok = (remove(path) == 0);
+    free(path);
+    return ok;
+}
+
+// archive entries are read-only
+static FILE *File_OpenArchived(const char *filename, const char *mode) {
+    if (strpbrk(mode, "wa+")) { return NULL; }
+    return Archive_Open(filename);
 }
 
 #ifdef OM_UNIX
-static char *resourceDirs[] = {
-    NULL, // ~/.openmadoola/ placeholder
-    "/usr/local/share/openmadoola/",
-    "/usr/share/openmadoola/",
-    "", // current working directory
-};
+// returns nonzero if the index knows whether filename exists
+static int File_IsIndexed(const char *filename) {
+    if (!resourcesIndexed) { return 0; }
+    if ((filename[0] == '/') || strstr(filename, "..")) { return 0; }
+    const char *slash = strchr(filename, '/');
+    if (!slash) { return 1; }
+    // only one level of subdirectories gets indexed
+    if (strchr(slash + 1, '/')) { return 0; }
+    for (int i = 0; i < numResourceSubdirs; i++) {
+        const char *subdir = resourceSubdirs[i];
+        size_t len = strlen(subdir);
+        if ((len == (size_t)(slash - filename)) && (strncmp(subdir, filename, len) == 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
 #endif
 
 FILE *File_OpenResource(const char *filename, const char *mode) {
-    // set up home data directory name
 #ifdef OM_UNIX
-    if (!resourceDirs[0]) {
-        char *homedir = getenv("HOME");
-        if (homedir) {
-            resourceDirs[0] = ommalloc(strlen(homedir) + 1 + strlen(OM_HOMEDIR) + 2);
-            strcpy(resourceDirs[0], homedir);
-            strcat(resourceDirs[0], "/");
-            strcat(resourceDirs[0], OM_HOMEDIR);
-            strcat(resourceDirs[0], "/");
+    if (File_IsIndexed(filename)) {
+        ResourceEntry *entry = bsearch(filename, resources, numResources, sizeof(ResourceEntry), File_CompareName);
+        if (entry) {
+            return fopen(entry->path, mode);
         }
+        FILE *fp = File_OpenArchived(filename, mode);
+        if (fp) { return fp; }
+        // the game only writes to the home directory, so that's the only
+        // place a file could have shown up since the index was built
+        return homePath ? File_OpenJoined(homePath, "", filename, mode) : NULL;
     }
 
+    char *homedir = getenv("HOME");
     for (int i = 0; i < ARRAY_LEN(resourceDirs); i++) {
-        if (resourceDirs[i]) {
-            checkBuffSize(strlen(resourceDirs[i]) + strlen(filename) + 1);
-            strcpy(filenameBuff, resourceDirs[i]);
-            strcat(filenameBuff, filename);
-            FILE *fp = fopen(filenameBuff, mode);
-            if (fp) { return fp; }
+        FILE *fp;
+        if (i == 0) {
+            if (!homedir) { continue; }
+            fp = File_OpenJoined(homedir, resourceDirs[i], filename, mode);
+        }
+        else {
+            fp = File_OpenJoined("", resourceDirs[i], filename, mode);
         }
+        if (fp) { return fp; }
     }
-    return NULL;
+    return File_OpenArchived(filename, mode);
 #else
-    return fopen(filename, mode);
+    FILE *fp = fopen(filename, mode);
+    return fp ? fp : File_OpenArchived(filename, mode);
 #endif
 }
 
@@ -141,4 +379,77 @@ Uint8 *File_Load(FILE *fp, int *size) {
     fread(data, 1, fileSize, fp);
     if (size) { *size = fileSize; }
     return data;
-}
\ No newline at end of file
+}
+
+int File_GetInfo(FILE *fp, Uint32 *size, uint64_t *mtime) {
+#ifdef OM_UNIX
+    // files opened from the archive are memory streams without a descriptor
+    if (fileno(fp) < 0) {
+        long pos = ftell(fp);
+        if ((pos < 0) || fseek(fp, 0, SEEK_END)) { return 0; }
+        *size = (Uint32)ftell(fp);
+        fseek(fp, pos, SEEK_SET);
+        *mtime = Archive_GetTime();
+        return 1;
+    }
+#endif
+#ifdef OM_WINDOWS
+    struct _stat64 info;
+    if (_fstat64(_fileno(fp), &info)) { return 0; }
+#else
+    struct stat info;
+    if (fstat(fileno(fp), &info)) { return 0; }
+#endif
+    *size = (Uint32)info.st_size;
+    *mtime = (uint64_t)info.st_mtime;
+    return 1;
+}
+
+Uint8 *File_Map(FILE *fp, Uint32 *size) {
+    Uint32 fileSize;
+    uint64_t mtime;
+    if (!File_GetInfo(fp, &fileSize, &mtime) || !fileSize) { return NULL; }
+#if defined(OM_UNIX)
+    void *data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (data == MAP_FAILED) { return NULL; }
+#elif defined(OM_WINDOWS)
+    HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) { return NULL; }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    // the view keeps the mapping alive
+    CloseHandle(mapping);
+    if (!data) { return NULL; }
+#else
+    // no way to map files, the caller has to read it instead
+    void *data = NULL;
+#endif
+    if (data) { *size = fileSize; }
+    return (Uint8 *)data;
+}
+
+void File_Unmap(Uint8 *data, Uint32 size) {
+#if defined(OM_UNIX)
+    munmap(data, size);
+#elif defined(OM_WINDOWS)
+    (void)size;
+    UnmapViewOfFile(data);
+#endif
+}
+
+int File_ReadAt(FILE *fp, Uint32 offset, void *out, Uint32 size) {
+#ifdef OM_UNIX
+    Uint8 *dst = out;
+    while (size) {
+        ssize_t amount = pread(fileno(fp), dst, size, (off_t)offset);
+        if (amount <= 0) { return 0; }
+        dst += amount;
+        offset += (Uint32)amount;
+        size -= (Uint32)amount;
+    }
+    return 1;
+#else
+    if (fseek(fp, (long)offset, SEEK_SET)) { return 0; }
+    return fread(out, 1, size, fp) == size;
+#endif
+}
@@ -49,6 +49,13 @@ void File_WriteUint32BE(Uint32 data, FILE *fp);
  */
 Uint32 File_ReadUint32BE(FILE *fp);
 
+/**
+ * @brief Makes the home directory and indexes the resource directories, so
+ * File_Open and File_OpenResource don't have to do it on every call. Must be
+ * run before any threads that open files are started.
+ */
+void File_Init(void);
+
 /**
  * @brief Opens the given file from $HOME/.openmadoola/filename on unix-like
  * systems, current working directory on other systems.
@@ -58,6 +65,31 @@ Uint32 File_ReadUint32BE(FILE *fp);
  */
 FILE *File_Open(const char *filename, const char *mode);
 
+/**
+ * @brief Flushes a file and waits for it to actually be written to disk
+ * @param fp the file to sync
+ * @returns zero on failure
+ */
+int File_Sync(FILE *fp);
+
+/**
+ * @brief Replaces a file in the same directory File_Open uses. The data is
+ * written to a temp file first, which then gets renamed over the old file,
+ * so the file always has either the old or the new contents.
+ * @param filename the file to write
+ * @param data what to write to it
+ * @param size how many bytes to write
+ * @returns zero on failure
+ */
+int File_WriteAtomic(const char *filename, const Uint8 *data, int size);
+
+/**
+ * @brief Deletes a file from the directory File_Open uses
+ * @param filename the file to delete
+ * @returns zero on failure
+ */
+int File_Remove(const char *filename);
+
 /**
  * @brief For opening a read-only data file. On unix-like systems, iterates
  * through a few directories before giving up (see resourceDirs array in file.c)
@@ -74,3 +106,39 @@ FILE *File_OpenResource(const char *filename, const char *mode);
  * @returns A pointer to the loaded data (malloced, user code must free it)
  */
 Uint8 *File_Load(FILE *fp, int *size);
+
+/**
+ * @brief Gets the size and modification time of an open file
+ * @param fp the file
+ * @param size (out) the file's size in bytes
+ * @param mtime (out) when the file was last modified, in seconds
+ * @returns zero if the info couldn't be gotten
+ */
+int File_GetInfo(FILE *fp, Uint32 *size, uint64_t *mtime);
+
+/**
+ * @brief Maps a file into memory read-only, so large files can be searched
+ * without being copied into RAM
+ * @param fp the file to map
+ * @param size (out) the size of the mapped data
+ * @returns the mapped data (release it with File_Unmap), or NULL if the file
+ * couldn't be mapped
+ */
+Uint8 *File_Map(FILE *fp, Uint32 *size);
+
+/**
+ * @brief Unmaps data mapped by File_Map
+ * @param data the mapped data
+ * @param size the size File_Map returned
+ */
+void File_Unmap(Uint8 *data, Uint32 size);
+
+/**
+ * @brief Reads part of a file without going through the whole thing
+ * @param fp the file to read from
+ * @param offset where to start reading, in bytes from the start of the file
+ * @param out where to put the data
+ * @param size how many bytes to read
+ * @returns zero if that many bytes couldn't be read
+ */
+int File_ReadAt(FILE *fp, Uint32 offset, void *out, Uint32 size);
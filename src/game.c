@@ -20,6 +20,7 @@
 #include <assert.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "camera.h"
 #include "darutos.h"
 #include "db.h"
@@ -44,6 +45,7 @@
 #include "screen.h"
 #include "sound.h"
 #include "sprite.h"
+#include "state.h"
 #include "system.h"
 #include "task.h"
 #include "title.h"
@@ -86,14 +88,6 @@ static void Game_SetRoom(Uint8 roomNum);
 static void Game_HandlePaletteShifting(void);
 static void Game_HandleRoomChange(void);
 
-typedef enum {
-    STAGE_EXIT_NEXTSTAGE,
-    STAGE_EXIT_DIED,
-    STAGE_EXIT_WON,
-    STAGE_EXIT_RESET,
-} GameRunStageExit;
-static int Game_RunStage(void);
-
 void Game_LoadSettings(void) {
     // initialize game type
     DBEntry *entry = DB_Find("gametype");
@@ -109,14 +103,14 @@ void Game_NewGame(void) {
     Game_InitNewGame();
     Save_SaveFile();
     Game_InitCommon();
-    RNG_Seed();
+    RNG_Seed("new game");
     Game_Run();
 }
 
 void Game_LoadGame(void) {
     health = 1000;
     Game_InitCommon();
-    RNG_Seed();
+    RNG_Seed("load game");
     Game_Run();
 }
 
@@ -138,8 +132,9 @@ static void Game_InitNewGame(void) {
 }
 
 static void Game_InitCommon(void) {
+    Alloc_AllowBegin();
     if (mapData) {
-        Map_FreeData(mapData);
+        Map_FreeData();
     }
     if (gameType == GAME_TYPE_ARCADE) {
         mapData = Rom_GetMapDataArcade();
@@ -147,6 +142,7 @@ static void Game_InitCommon(void) {
     else {
         mapData = Rom_GetMapData();
     }
+    Alloc_AllowEnd();
     score = 0;
     lives = 3;
     paused = 0;
@@ -296,7 +292,7 @@ void Game_RecordDemoInit(char *filename, Uint8 _gameType, Uint8 _stage, Sint16 _
     data.bootsLevel = _bootsLevel;
     memcpy(data.weaponLevels, _weaponLevels, sizeof(data.weaponLevels));
     Game_InitDemo(&data);
-    Demo_Record(filename, &data);
+    Demo_Record(filename, &data, DEMO_CHECKPOINT_INTERVAL);
     recordDemoInitialized = 1;
 }
 
@@ -308,6 +304,76 @@ void Game_RecordDemoTask(void) {
     Platform_Quit();
 }
 
+static int stageResult = STAGE_RUNNING;
+void Game_StageInit(Uint8 _gameType, Uint8 _stage) {
+    gameType = _gameType;
+    Game_InitNewGame();
+    Game_InitCommon();
+    stage = _stage;
+    stageResult = STAGE_RUNNING;
+}
+
+void Game_StageTask(void) {
+    stageResult = Game_RunStage();
+    // nothing else to do until someone calls Task_Init again
+    while (1) {
+        Task_Yield();
+    }
+}
+
+int Game_StageResult(void) {
+    return stageResult;
+}
+
+void Game_NetplayTask(void) {
+    // like Game_Run, but without anything that touches the disk, since
+    // rollbacks can run the same frame more than once
+    while (1) {
+        switch (Game_RunStage()) {
+        case STAGE_EXIT_NEXTSTAGE:
+            stage++;
+            stage &= 0xf;
+            if (stage > highestReachedStage) {
+                highestReachedStage = stage;
+                orbCollected = 0;
+            }
+            break;
+
+        case STAGE_EXIT_DIED:
+            Screen_GameOver();
+            health = 1000;
+            break;
+
+        case STAGE_EXIT_WON:
+            Ending_Run();
+            // fall through
+        case STAGE_EXIT_RESET:
+            Game_InitNewGame();
+            score = 0;
+            lives = 3;
+            currentWeapon = WEAPON_SWORD;
+            break;
+        }
+    }
+}
+
+void Game_RegisterState(void) {
+    State_Register(&gameType, sizeof(gameType), 0);
+    State_Register(&paused, sizeof(paused), 0);
+    State_Register(&stage, sizeof(stage), 0);
+    State_Register(&highestReachedStage, sizeof(highestReachedStage), 0);
+    State_Register(&orbCollected, sizeof(orbCollected), 0);
+    State_Register(&roomChangeTimer, sizeof(roomChangeTimer), 0);
+    State_Register(&bossActive, sizeof(bossActive), 0);
+    State_Register(&numBossObjs, sizeof(numBossObjs), 0);
+    State_Register(bossDefeated, sizeof(bossDefeated), 0);
+    State_Register(&gameFrames, sizeof(gameFrames), 0);
+    State_Register(&keywordDisplay, sizeof(keywordDisplay), 0);
+    State_Register(&fountainUsed, sizeof(fountainUsed), 0);
+    State_Register(&score, sizeof(score), 0);
+    State_Register(&stageResult, sizeof(stageResult), 0);
+}
+
 void Game_PlayDemo(char *filename) {
     DemoData data;
     if (!Demo_Playback(filename, &data)) {
@@ -321,6 +387,17 @@ void Game_PlayDemo(char *filename) {
     Demo_Uninit();
 }
 
+static char *viewDemoFilename = NULL;
+void Game_ViewDemoInit(char *filename) {
+    viewDemoFilename = filename;
+}
+
+void Game_ViewDemoTask(void) {
+    assert(viewDemoFilename);
+    Game_PlayDemo(viewDemoFilename);
+    Platform_Quit();
+}
+
 static void Game_InitDemo(DemoData *data) {
     Game_InitNewGame();
     Game_InitCommon();
@@ -342,6 +419,18 @@ static int Game_RunStage(void) {
     magic = maxMagic;
     fountainUsed = 0;
 
+    // load the music this stage could need while the stage intro plays. Warp
+    // doors can lead to any room, so that's every room's song.
+    int stageSounds[ARRAY_LEN(mapData->rooms) + 3];
+    int numStageSounds = 0;
+    for (int i = 0; i < ARRAY_LEN(mapData->rooms); i++) {
+        stageSounds[numStageSounds++] = mapData->rooms[i].song;
+    }
+    stageSounds[numStageSounds++] = (gameType == GAME_TYPE_ORIGINAL) ? MUS_BOSS : MUS_BOSS_ARCADE;
+    stageSounds[numStageSounds++] = MUS_ITEM;
+    stageSounds[numStageSounds++] = MUS_CLEAR;
+    Sound_Prefetch(stageSounds, numStageSounds);
+
     Sound_Reset();
     Sound_Play(MUS_START);
     if (gameType == GAME_TYPE_ARCADE) {
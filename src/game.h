@@ -69,12 +69,63 @@ void Game_RecordDemoInit(char *filename, Uint8 _gameType, Uint8 _stage, Sint16 _
  */
 void Game_RecordDemoTask(void);
 
+#define STAGE_RUNNING -1
+typedef enum {
+    STAGE_EXIT_NEXTSTAGE,
+    STAGE_EXIT_DIED,
+    STAGE_EXIT_WON,
+    STAGE_EXIT_RESET,
+} GameRunStageExit;
+
+/**
+ * @brief Gets ready to play a single stage with new game stats.
+ * @param _gameType game type number
+ * @param _stage stage number (0-15)
+ */
+void Game_StageInit(Uint8 _gameType, Uint8 _stage);
+
+/**
+ * @brief Plays the stage set up by Game_StageInit and then idles. Should only
+ * be run (as a task) after Game_StageInit.
+ */
+void Game_StageTask(void);
+
+/**
+ * @returns STAGE_RUNNING if the stage from Game_StageTask is still being
+ * played, otherwise how it ended (see GameRunStageExit)
+ */
+int Game_StageResult(void);
+
+/**
+ * @brief Plays through the game starting at the stage set up by
+ * Game_StageInit, without saving anything to disk. Should only be run (as a
+ * task) after Game_StageInit.
+ */
+void Game_NetplayTask(void);
+
+/**
+ * @brief Adds the game's variables to the game state.
+ */
+void Game_RegisterState(void);
+
 /**
  * @brief Plays back a stage demo.
  * @param filename demo file to load
  */
 void Game_PlayDemo(char *filename);
 
+/**
+ * @brief Sets the demo file for Game_ViewDemoTask to play.
+ * @param filename demo file to load
+ */
+void Game_ViewDemoInit(char *filename);
+
+/**
+ * @brief Plays back a demo and quits once it's over. Should only be run (as a
+ * task) after Game_ViewDemoInit.
+ */
+void Game_ViewDemoTask(void);
+
 /**
  * @brief Plays the song associated with the current room.
 */
@@ -32,14 +32,21 @@
 
 // 8bpp chunky version of chrRom
 static Uint8 *chrData;
+static Arena graphicsArena = ARENA_INIT(ALLOC_TAG_GRAPHICS, 64 * 1024);
 // the palette we're using to draw this frame
 static Uint8 *drawPalette;
 // where we're drawing to
 static Uint8 *screen;
+// if non-NULL, gets drawn to instead of the platform framebuffer
+static Uint8 *customFramebuffer = NULL;
+// nonzero = don't draw anything
+static int skipDrawing = 0;
 
 int Graphics_Init(void) {
+    // already loaded from the asset cache
+    if (chrData) { return 1; }
     // convert planar 2bpp to chunky 8bpp
-    chrData = ommalloc(chrRomSize * 4);
+    chrData = Arena_Alloc(&graphicsArena, chrRomSize * 4);
     int chrCursor = 0;
     for (int i = 0; i < (chrRomSize / TILE_PACKED_SIZE); i++) {
         int tilePos = i * TILE_PACKED_SIZE;
@@ -66,13 +73,33 @@ int Graphics_Init(void) {
     return 1;
 }
 
+Uint8 *Graphics_GetChrData(void) {
+    return chrData;
+}
+
+void Graphics_SetChrData(Uint8 *data) {
+    chrData = data;
+}
+
 void Graphics_StartFrame(void) {
-    screen = Platform_GetFramebuffer();
+    screen = customFramebuffer ? customFramebuffer : Platform_GetFramebuffer();
     drawPalette = Palette_Run();
-    memset(screen, colorPalette[0], FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT);
+    if (!skipDrawing) {
+        memset(screen, colorPalette[0], FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT);
+    }
+}
+
+void Graphics_SetFramebuffer(Uint8 *framebuffer) {
+    customFramebuffer = framebuffer;
+}
+
+void Graphics_SetSkip(int skip) {
+    skipDrawing = skip;
 }
 
 void Graphics_DrawTile(int x, int y, int tilenum, int palnum, int mirror) {
+    if (skipDrawing) { return; }
+
     // don't draw the tile at all if it's entirely offscreen
     if ((x < -TILE_WIDTH) || (x >= SCREEN_WIDTH) || (y < -TILE_HEIGHT) || (y >= SCREEN_HEIGHT)) {
         return;
@@ -34,11 +34,40 @@
 */
 int Graphics_Init(void);
 
+/**
+ * @returns the 8bpp version of chrRom that Graphics_Init builds (chrRomSize * 4
+ * bytes), or NULL if it hasn't been built yet
+ */
+Uint8 *Graphics_GetChrData(void);
+
+/**
+ * @brief Uses already converted CHR data instead of having Graphics_Init
+ * build it. Must be called before Graphics_Init.
+ * @param data chrRomSize * 4 bytes of 8bpp tile data
+ */
+void Graphics_SetChrData(Uint8 *data);
+
 /**
  * @brief Should be run at the start of each frame
  */
 void Graphics_StartFrame(void);
 
+/**
+ * @brief Makes the engine draw to the given buffer instead of the platform
+ * framebuffer. Takes effect on the next Graphics_StartFrame.
+ * @param framebuffer buffer of FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT bytes,
+ * or NULL to go back to the platform framebuffer
+ */
+void Graphics_SetFramebuffer(Uint8 *framebuffer);
+
+/**
+ * @brief Enables or disables drawing. When disabled, Graphics_StartFrame and
+ * Graphics_DrawTile don't touch the framebuffer, which speeds up running
+ * frames nobody is going to look at.
+ * @param skip nonzero = don't draw, zero = draw
+ */
+void Graphics_SetSkip(int skip);
+
 /**
  * @brief draws an 8x8 tile to the framebuffer
  * @param x tile x pos
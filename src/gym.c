@@ -0,0 +1,115 @@
+/* gym.c: Programmatic step/reset interface for automated play
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "constants.h"
+#include "game.h"
+#include "graphics.h"
+#include "gym.h"
+#include "joy.h"
+#include "lucia.h"
+#include "map.h"
+#include "object.h"
+#include "rng.h"
+#include "sound.h"
+#include "state.h"
+#include "system.h"
+#include "task.h"
+
+static GymObservation *observation = NULL;
+// state from before the last undrawn frame, for drawing it if the episode
+// ends on it. NULL if snapshots aren't supported.
+static Buffer *stepState = NULL;
+
+static void Gym_Observe(void) {
+    observation->result = Game_StageResult();
+    observation->health = health;
+    observation->magic = magic;
+    observation->stage = stage;
+    observation->room = currRoom;
+    for (int i = 0; i < MAX_OBJECTS; i++) {
+        observation->objects[i].type = objects[i].type;
+        observation->objects[i].hp = objects[i].hp;
+        observation->objects[i].x = objects[i].x.v;
+        observation->objects[i].y = objects[i].y.v;
+    }
+}
+
+int Gym_Init(GymObservation *obs) {
+    if (!System_InitHeadless()) { return 0; }
+
+    observation = obs;
+    memset(observation, 0, sizeof(GymObservation));
+    observation->version = GYM_OBSERVATION_VERSION;
+    observation->frameWidth = SCREEN_WIDTH;
+    observation->frameHeight = SCREEN_HEIGHT;
+    observation->framePitch = FRAMEBUFFER_WIDTH;
+    observation->frameOffset = (TILE_HEIGHT * FRAMEBUFFER_WIDTH) + TILE_WIDTH;
+    Graphics_SetFramebuffer(observation->framebuffer);
+    Gym_Reset(0, gameType, 0);
+    if (State_Init()) { stepState = Buffer_Init(64 * 1024); }
+    return 1;
+}
+
+void Gym_Reset(Uint8 stageNum, Uint8 type, Uint16 seed) {
+    Game_StageInit(type, stageNum & 0xf);
+    rngVal = (Uint8)seed;
+    gameFrames = (Uint8)(seed >> 8);
+    Joy_Inject(0);
+    Task_Init(Game_StageTask);
+    observation->frame = 0;
+    Gym_Observe();
+}
+
+static void Gym_RunFrame(Uint32 joypadBits, int draw) {
+    Graphics_SetSkip(!draw);
+    Graphics_StartFrame();
+    Joy_Inject(joypadBits);
+    Joy_Update();
+    Task_Run();
+    Graphics_SetSkip(0);
+}
+
+GymObservation *Gym_Step(Uint32 joypadBits, int frames) {
+    for (int i = 0; i < frames; i++) {
+        // episode's over, the caller has to reset
+        if (Game_StageResult() != STAGE_RUNNING) { break; }
+        // only draw the frame the caller is going to see, which is either the
+        // last one or the one the episode ends on
+        if ((i == (frames - 1)) || !stepState) {
+            Gym_RunFrame(joypadBits, 1);
+        }
+        else {
+            State_Save(stepState);
+            Gym_RunFrame(joypadBits, 0);
+            if (Game_StageResult() != STAGE_RUNNING) {
+                // run the frame again with drawing on, its sounds already
+                // got played
+                State_Load(stepState);
+                Sound_SetSkip(1);
+                Gym_RunFrame(joypadBits, 1);
+                Sound_SetSkip(0);
+            }
+        }
+        observation->frame++;
+    }
+    Gym_Observe();
+    return observation;
+}
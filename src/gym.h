@@ -0,0 +1,80 @@
+/* gym.h: Programmatic step/reset interface for automated play
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+#include "object.h"
+#include "platform.h"
+
+// bump this whenever the GymObservation layout changes
+#define GYM_OBSERVATION_VERSION 1
+
+typedef struct {
+    Uint8 type;   // object type (OBJ_NONE = slot is empty, see object.h)
+    Uint8 pad;
+    Sint16 hp;
+    Sint16 x;     // map position, 8.8 fixed point (high byte = metatile)
+    Sint16 y;
+} GymObject;
+
+typedef struct {
+    Uint32 version;     // GYM_OBSERVATION_VERSION
+    Uint32 frame;       // frames stepped since the last reset
+    Sint32 result;      // STAGE_RUNNING or a GameRunStageExit value (see game.h)
+    Sint16 health;
+    Sint16 magic;
+    Uint8 stage;
+    Uint8 room;
+    Uint8 pad[2];
+    // the framebuffer has a 1 tile border around it (see platform.h), so the
+    // visible 256x240 image starts frameOffset bytes in with a stride of framePitch
+    Uint32 frameWidth;
+    Uint32 frameHeight;
+    Uint32 framePitch;
+    Uint32 frameOffset;
+    GymObject objects[MAX_OBJECTS];
+    // NES palette indices, drawn to directly by the engine
+    Uint8 framebuffer[FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT];
+} GymObservation;
+
+/**
+ * @brief Initializes the engine headless and sets up the observation buffer.
+ * @param obs where observations get written. The engine draws straight into
+ * obs->framebuffer so it never gets copied. Can point into shared memory.
+ * @returns nonzero on success, zero on failure
+ */
+int Gym_Init(GymObservation *obs);
+
+/**
+ * @brief Starts a new episode.
+ * @param stageNum stage number (0-15)
+ * @param type game type (GAME_TYPE_ORIGINAL, GAME_TYPE_PLUS, GAME_TYPE_ARCADE)
+ * @param seed RNG seed (low byte = rngVal, high byte = gameFrames)
+ */
+void Gym_Reset(Uint8 stageNum, Uint8 type, Uint16 seed);
+
+/**
+ * @brief Runs the game with the given input held, stopping early if the
+ * episode ends. Only the last frame that runs gets drawn, and nothing is
+ * presented to the screen or sent to the audio device.
+ * @param joypadBits buttons to hold (JOY_UP, JOY_DOWN, etc)
+ * @param frames how many frames to run for
+ * @returns the observation after the last frame
+ */
+GymObservation *Gym_Step(Uint32 joypadBits, int frames);
@@ -0,0 +1,178 @@
+/* gymserver.c: Local socket server for the gym API
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// needed for shm_open, sockets, etc
+#define _POSIX_C_SOURCE 200809L
+// first because it contains the OM_UNIX define
+#include "constants.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef OM_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "game.h"
+#include "gym.h"
+#include "gymserver.h"
+
+#ifdef OM_UNIX
+static GymObservation *obs;
+static char shmName[64];
+
+// returns nonzero if the whole buffer was transferred
+static int GymServer_Read(int fd, void *buf, size_t len) {
+    Uint8 *ptr = buf;
+    while (len) {
+        ssize_t count = read(fd, ptr, len);
+        if (count <= 0) { return 0; }
+        ptr += count;
+        len -= count;
+    }
+    return 1;
+}
+
+static int GymServer_Write(int fd, void *buf, size_t len) {
+    Uint8 *ptr = buf;
+    while (len) {
+        ssize_t count = write(fd, ptr, len);
+        if (count <= 0) { return 0; }
+        ptr += count;
+        len -= count;
+    }
+    return 1;
+}
+
+// returns zero if the server should shut down
+static int GymServer_Handle(GymRequest *req, GymReply *reply) {
+    memset(reply, 0, sizeof(GymReply));
+    switch (req->cmd) {
+    case GYM_CMD_HELLO:
+        strcpy(reply->shmName, shmName);
+        break;
+
+    case GYM_CMD_RESET:
+        if ((req->args[0] > 15) || (req->args[1] > GAME_TYPE_ARCADE) || (req->args[2] > 0xffff)) {
+            reply->status = -1;
+        }
+        else {
+            Gym_Reset((Uint8)req->args[0], (Uint8)req->args[1], (Uint16)req->args[2]);
+        }
+        break;
+
+    case GYM_CMD_STEP:
+        if ((req->args[0] > 0xff) || (req->args[1] < 1) || (req->args[1] > INT_MAX)) {
+            reply->status = -1;
+        }
+        else {
+            Gym_Step(req->args[0], (int)req->args[1]);
+        }
+        break;
+
+    case GYM_CMD_QUIT:
+        return 0;
+
+    default:
+        reply->status = -1;
+        break;
+    }
+    reply->frame = obs->frame;
+    reply->result = obs->result;
+    reply->obsSize = sizeof(GymObservation);
+    return 1;
+}
+#endif
+
+int GymServer_Run(const char *socketPath) {
+#ifdef OM_UNIX
+    // set up the observation buffer in shared memory
+    snprintf(shmName, sizeof(shmName), "/openmadoola-gym-%d", (int)getpid());
+    int shmFd = shm_open(shmName, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shmFd < 0) {
+        perror("shm_open");
+        return 0;
+    }
+    if (ftruncate(shmFd, sizeof(GymObservation)) < 0) {
+        perror("ftruncate");
+        shm_unlink(shmName);
+        return 0;
+    }
+    obs = mmap(NULL, sizeof(GymObservation), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+    close(shmFd);
+    if (obs == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(shmName);
+        return 0;
+    }
+    if (!Gym_Init(obs)) {
+        shm_unlink(shmName);
+        return 0;
+    }
+
+    // set up the socket
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        shm_unlink(shmName);
+        return 0;
+    }
+    strcpy(addr.sun_path, socketPath);
+    unlink(socketPath);
+    int serverFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((serverFd < 0) ||
+        (bind(serverFd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (listen(serverFd, 1) < 0)) {
+        perror("socket");
+        shm_unlink(shmName);
+        return 0;
+    }
+    printf("Gym server listening on %s (observations in %s)\n", socketPath, shmName);
+
+    // serve one client at a time until one of them tells us to quit
+    int running = 1;
+    while (running) {
+        int clientFd = accept(serverFd, NULL, NULL);
+        if (clientFd < 0) { continue; }
+        GymRequest req;
+        GymReply reply;
+        while (GymServer_Read(clientFd, &req, sizeof(req))) {
+            running = GymServer_Handle(&req, &reply);
+            if (!GymServer_Write(clientFd, &reply, sizeof(reply)) || !running) { break; }
+        }
+        close(clientFd);
+    }
+
+    close(serverFd);
+    unlink(socketPath);
+    munmap(obs, sizeof(GymObservation));
+    shm_unlink(shmName);
+    return 1;
+#else
+    (void)socketPath;
+    fprintf(stderr, "The gym server is only supported on UNIX-like platforms.\n");
+    return 0;
+#endif
+}
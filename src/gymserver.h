@@ -0,0 +1,60 @@
+/* gymserver.h: Local socket server for the gym API
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+
+// Protocol: the client connects to the socket and sends GymRequests, and the
+// server answers each one with a GymReply. Both are sent in the host's native
+// byte order since the client has to be on the same machine anyway. The
+// observation (see GymObservation in gym.h) lives in a POSIX shared memory
+// object whose name is returned by GYM_CMD_HELLO, so frames never go through
+// the socket.
+
+typedef enum {
+    // no args, returns the shared memory name & size
+    GYM_CMD_HELLO = 0,
+    // args: stage (0-15), game type, seed
+    GYM_CMD_RESET = 1,
+    // args: joypad bits, number of frames
+    GYM_CMD_STEP  = 2,
+    // no args, shuts down the server
+    GYM_CMD_QUIT  = 3,
+} GYM_CMD;
+
+typedef struct {
+    Uint32 cmd;
+    Uint32 args[3];
+} GymRequest;
+
+typedef struct {
+    Sint32 status;   // 0 = success, nonzero = bad request
+    Uint32 frame;    // same as GymObservation's frame
+    Sint32 result;   // same as GymObservation's result
+    Uint32 obsSize;  // sizeof(GymObservation)
+    char shmName[64];
+} GymReply;
+
+/**
+ * @brief Initializes the engine headless and serves gym requests on a UNIX
+ * domain socket until a client sends GYM_CMD_QUIT.
+ * @param socketPath path to create the socket at
+ * @returns nonzero if the server shut down cleanly, zero on error
+ */
+int GymServer_Run(const char *socketPath);
@@ -20,6 +20,7 @@
 #include "constants.h"
 #include "hud.h"
 #include "sprite.h"
+#include "state.h"
 #include "weapon.h"
 
 // the tile number of the "0" tile
@@ -106,6 +107,13 @@ static Sprite *weaponSprite;
 static Sprite *weaponBG1;
 static Sprite *weaponBG2;
 
+void HUD_RegisterState(void) {
+    // these point into the sprite list
+    State_Register(&weaponSprite, sizeof(weaponSprite), STATE_NOHASH);
+    State_Register(&weaponBG1, sizeof(weaponBG1), STATE_NOHASH);
+    State_Register(&weaponBG2, sizeof(weaponBG2), STATE_NOHASH);
+}
+
 void HUD_WeaponInit(Sint16 x, Sint16 y) {
     weaponBG1 = Sprite_Get();
     weaponBG1->size = SPRITE_8X16;
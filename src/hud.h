@@ -37,3 +37,8 @@ void HUD_WeaponInit(Sint16 x, Sint16 y);
  * @brief Updates the HUD weapon display from the currently selected weapon
  */
 void HUD_Weapon(void);
+
+/**
+ * @brief Adds the HUD's sprite pointers to the game state.
+ */
+void HUD_RegisterState(void);
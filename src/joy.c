@@ -32,6 +32,9 @@ Uint8 joyDir;
 Uint32 joyRaw;
 Uint32 joyEdgeRaw;
 
+static int injecting = 0;
+static Uint32 injectedInput;
+
 static int keyMappings[] = {
     INPUT_KEY_D,
     INPUT_KEY_A,
@@ -135,26 +138,47 @@ void Joy_Init(void) {
     }
 }
 
-void Joy_Update(void) {
-    Uint32 joyLast = joy;
-    Uint32 joyLastRaw = joyRaw;
+void Joy_Inject(Uint32 input) {
+    injecting = 1;
+    injectedInput = input;
+}
 
-    joyRaw = 0;
+void Joy_StopInject(void) {
+    injecting = 0;
+}
+
+Uint32 Joy_ReadController(void) {
+    Uint32 buttons = 0;
     Uint32 mask = 1;
     for (int i = 0; i < ARRAY_LEN(keyMappings); i++) {
-        if (inputState[keyMappings[i]]) { joyRaw |= mask; }
-        if (inputState[gamepadMappings[i]]) { joyRaw |= mask; }
+        if (inputState[keyMappings[i]]) { buttons |= mask; }
+        if (inputState[gamepadMappings[i]]) { buttons |= mask; }
         mask <<= 1;
     }
+    return buttons;
+}
+
+void Joy_Update(void) {
+    Uint32 joyLast = joy;
+    Uint32 joyLastRaw = joyRaw;
+
+    if (injecting) {
+        joyRaw = injectedInput;
+    }
+    else {
+        joyRaw = Joy_ReadController();
+    }
 
     if (Demo_Playing()) {
         joy = Demo_GetInput();
     }
     else {
-        joy = joyRaw;
+        // recording has to happen before joy changes, the demo's state hash
+        // checkpoints are taken from the same point during playback
         if (Demo_Recording()) {
-            Demo_RecordInput(joy);
+            Demo_RecordInput(joyRaw);
         }
+        joy = joyRaw;
     }
 
     joyEdge = (~joyLast) & joy;
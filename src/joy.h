@@ -83,6 +83,24 @@ void Joy_SaveMappings(void);
  */
 void Joy_Init(void);
 
+/**
+ * @brief Overrides the physical controller with the given buttons until
+ * Joy_StopInject is called. Used for driving the game from code (gym API, etc).
+ * @param input joypad bits (JOY_UP, JOY_DOWN, etc) to use for the next Joy_Update
+ */
+void Joy_Inject(Uint32 input);
+
+/**
+ * @brief Goes back to reading the physical controller after Joy_Inject
+ */
+void Joy_StopInject(void);
+
+/**
+ * @brief Reads the physical controller without updating any of the joy variables
+ * @returns joypad bits (JOY_UP, JOY_DOWN, etc) for the buttons being held
+ */
+Uint32 Joy_ReadController(void);
+
 /**
  * @brief updates the joy and joyEdge variables. Should be run each frame
 */
@@ -0,0 +1,165 @@
+/* lz4.c: LZ4 block compression
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Each sequence is a token byte (high nybble: literal count, low nybble:
+// match length - 4), extra literal count bytes if the count is 15 or more,
+// the literals, a 16-bit little endian match offset, then extra match length
+// bytes if that nybble is 15. The last sequence is just literals.
+
+#include <string.h>
+
+#include "constants.h"
+#include "lz4.h"
+
+#define MIN_MATCH 4
+// the format requires the last 5 bytes to be literals, and the last match to
+// start at least 12 bytes before the end
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+#define MAX_OFFSET 65535
+#define HASH_BITS 12
+
+static Uint32 Lz4_Read32(const Uint8 *ptr) {
+    Uint32 val;
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+static int Lz4_Hash(Uint32 val) {
+    return (int)((val * 2654435761u) >> (32 - HASH_BITS));
+}
+
+// writes a length that didn't fit in a token nybble
+static Uint8 *Lz4_WriteLength(Uint8 *dst, Uint8 *dstEnd, int len) {
+    while (len >= 255) {
+        if (dst >= dstEnd) { return NULL; }
+        *dst++ = 255;
+        len -= 255;
+    }
+    if (dst >= dstEnd) { return NULL; }
+    *dst++ = (Uint8)len;
+    return dst;
+}
+
+static Uint8 *Lz4_WriteSequence(Uint8 *dst, Uint8 *dstEnd, const Uint8 *literals, int literalLen, int offset, int matchLen) {
+    if (dst >= dstEnd) { return NULL; }
+    Uint8 *token = dst++;
+    *token = (Uint8)((MIN(literalLen, 15) << 4));
+    if (literalLen >= 15) {
+        dst = Lz4_WriteLength(dst, dstEnd, literalLen - 15);
+        if (!dst) { return NULL; }
+    }
+    if ((dstEnd - dst) < literalLen) { return NULL; }
+    memcpy(dst, literals, literalLen);
+    dst += literalLen;
+    // the last sequence doesn't have a match
+    if (!matchLen) { return dst; }
+
+    if ((dstEnd - dst) < 2) { return NULL; }
+    *dst++ = (Uint8)(offset & 0xff);
+    *dst++ = (Uint8)(offset >> 8);
+    matchLen -= MIN_MATCH;
+    *token |= (Uint8)MIN(matchLen, 15);
+    if (matchLen >= 15) {
+        dst = Lz4_WriteLength(dst, dstEnd, matchLen - 15);
+    }
+    return dst;
+}
+
+int Lz4_Compress(const Uint8 *src, int srcSize, Uint8 *dst, int dstCapacity) {
+    int table[1 << HASH_BITS];
+    for (int i = 0; i < ARRAY_LEN(table); i++) {
+        table[i] = -1;
+    }
+    Uint8 *out = dst;
+    Uint8 *outEnd = dst + dstCapacity;
+    int anchor = 0;
+    int pos = 0;
+
+    while (pos < (srcSize - MF_LIMIT)) {
+        Uint32 val = Lz4_Read32(src + pos);
+        int hash = Lz4_Hash(val);
+        int candidate = table[hash];
+        table[hash] = pos;
+        if ((candidate < 0) || ((pos - candidate) > MAX_OFFSET) || (Lz4_Read32(src + candidate) != val)) {
+            pos++;
+            continue;
+        }
+        // extend the match as far as the format allows
+        int matchLen = MIN_MATCH;
+        int matchLimit = srcSize - LAST_LITERALS;
+        while (((pos + matchLen) < matchLimit) && (src[candidate + matchLen] == src[pos + matchLen])) {
+            matchLen++;
+        }
+        out = Lz4_WriteSequence(out, outEnd, src + anchor, pos - anchor, pos - candidate, matchLen);
+        if (!out) { return 0; }
+        pos += matchLen;
+        anchor = pos;
+    }
+
+    out = Lz4_WriteSequence(out, outEnd, src + anchor, srcSize - anchor, 0, 0);
+    if (!out) { return 0; }
+    return (int)(out - dst);
+}
+
+// reads the rest of a length that didn't fit in a token nybble
+static int Lz4_ReadLength(const Uint8 **src, const Uint8 *srcEnd, int *len) {
+    Uint8 byte;
+    do {
+        if (*src >= srcEnd) { return 0; }
+        byte = *(*src)++;
+        *len += byte;
+        if (*len < 0) { return 0; }
+    } while (byte == 255);
+    return 1;
+}
+
+int Lz4_Decompress(const Uint8 *src, int srcSize, Uint8 *dst, int dstSize) {
+    const Uint8 *srcEnd = src + srcSize;
+    Uint8 *out = dst;
+    Uint8 *outEnd = dst + dstSize;
+
+    while (src < srcEnd) {
+        Uint8 token = *src++;
+        int literalLen = token >> 4;
+        if ((literalLen == 15) && !Lz4_ReadLength(&src, srcEnd, &literalLen)) { return 0; }
+        if (((srcEnd - src) < literalLen) || ((outEnd - out) < literalLen)) { return 0; }
+        memcpy(out, src, literalLen);
+        src += literalLen;
+        out += literalLen;
+        // the last sequence ends after its literals
+        if (src == srcEnd) { break; }
+
+        if ((srcEnd - src) < 2) { return 0; }
+        int offset = src[0] | (src[1] << 8);
+        src += 2;
+        if ((offset == 0) || (offset > (out - dst))) { return 0; }
+        int matchLen = token & 0xf;
+        if ((matchLen == 15) && !Lz4_ReadLength(&src, srcEnd, &matchLen)) { return 0; }
+        matchLen += MIN_MATCH;
+        if ((outEnd - out) < matchLen) { return 0; }
+        // matches can overlap the data they're copying, so go a byte at a time
+        const Uint8 *match = out - offset;
+        for (int i = 0; i < matchLen; i++) {
+            out[i] = match[i];
+        }
+        out += matchLen;
+    }
+    return out == outEnd;
+}
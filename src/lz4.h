@@ -0,0 +1,45 @@
+/* lz4.h: LZ4 block compression
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+
+// Raw LZ4 blocks (no frame header), compatible with the reference
+// implementation's LZ4_compress_default/LZ4_decompress_safe.
+
+/**
+ * @brief Compresses data. Only does a simple greedy search, which is fine for
+ * packing files ahead of time.
+ * @param src the data to compress
+ * @param srcSize size of the data in bytes
+ * @param dst where to put the compressed data
+ * @param dstCapacity how many bytes can go in dst
+ * @returns the compressed size, or 0 if it didn't fit in dstCapacity bytes
+ */
+int Lz4_Compress(const Uint8 *src, int srcSize, Uint8 *dst, int dstCapacity);
+
+/**
+ * @brief Decompresses data. Safe to use on untrusted input.
+ * @param src the compressed data
+ * @param srcSize size of the compressed data in bytes
+ * @param dst where to put the decompressed data
+ * @param dstSize the decompressed size
+ * @returns 1 if exactly dstSize bytes were decompressed, 0 on corrupt data
+ */
+int Lz4_Decompress(const Uint8 *src, int srcSize, Uint8 *dst, int dstSize);
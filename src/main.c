@@ -24,11 +24,19 @@
 #include <Windows.h>
 #endif
 
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "demo.h"
 #include "game.h"
+#include "gymserver.h"
+#include "netplay.h"
+#include "netplaytest.h"
+#include "relay.h"
+#include "rng.h"
+#include "soundrender.h"
 #include "soundtest.h"
 #include "system.h"
 #include "task.h"
@@ -64,6 +72,56 @@ int main(int argc, char **argv) {
     }
 #endif
 
+    // -seed works along with any of the other options, so it gets taken out
+    // of the argument list before they're checked
+    for (int i = 1; i < (argc - 1); i++) {
+        if (checkFlag(argv[i], "seed") || (strcmp(argv[i], "--seed") == 0)) {
+            // strtoul skips whitespace and accepts a sign, so check for a
+            // digit first
+            char *end;
+            unsigned long seed = strtoul(argv[i + 1], &end, 10);
+            if (!isdigit((unsigned char)argv[i + 1][0]) || *end || (seed > 65535)) {
+                fprintf(stderr, "Seed must be between 0-65535.\n");
+                return -1;
+            }
+            RNG_SetSeed((Uint16)seed);
+            memmove(&argv[i], &argv[i + 2], (argc - i - 1) * sizeof(char *));
+            argc -= 2;
+            break;
+        }
+    }
+
+    // the gym server runs headless, so it has to be checked for before the
+    // platform code gets initialized
+    if ((argc == 3) && checkFlag(argv[1], "g")) {
+        return GymServer_Run(argv[2]) ? 0 : -1;
+    }
+    // same with the netplay test relay
+    if (((argc == 6) || (argc == 7)) && checkFlag(argv[1], "relay")) {
+        RelayConfig config;
+        config.portA = (Uint16)atoi(argv[2]);
+        config.portB = (Uint16)atoi(argv[3]);
+        config.latency = atoi(argv[4]);
+        config.jitter = atoi(argv[5]);
+        config.loss = (argc == 7) ? atoi(argv[6]) : 0;
+        return Relay_Run(&config) ? 0 : -1;
+    }
+    // and the netplay test that runs a relay and both players
+    if ((argc >= 2) && (argc <= 4) && checkFlag(argv[1], "nettest")) {
+        int delay = (argc >= 3) ? atoi(argv[2]) : 2;
+        int frames = (argc == 4) ? atoi(argv[3]) : NETPLAYTEST_DEFAULT_FRAMES;
+        if (frames < 1) {
+            fprintf(stderr, "Frame count must be at least 1.\n");
+            return -1;
+        }
+        return NetplayTest_Run(delay, (Uint32)frames) ? 0 : -1;
+    }
+    // and the offline sound renderer
+    if (((argc == 4) || (argc == 5)) && checkFlag(argv[1], "w")) {
+        int seconds = (argc == 5) ? atoi(argv[4]) : SOUNDRENDER_DEFAULT_SECONDS;
+        return SoundRender_Run(argv[2], argv[3], seconds) ? 0 : -1;
+    }
+
     if (!System_Init()) { return -1; }
 
     if ((argc == 3) && checkFlag(argv[1], "p")) {
@@ -109,6 +167,33 @@ int main(int argc, char **argv) {
         Game_RecordDemoInit(filename, type, stage - 1, health, magic, boots, weapons);
         Task_Init(Game_RecordDemoTask);
     }
+    else if ((argc == 3) && checkFlag(argv[1], "d")) {
+        Game_ViewDemoInit(argv[2]);
+        Task_Init(Game_ViewDemoTask);
+        System_EnableDemoSeeking();
+    }
+    else if ((argc >= 6) && (argc <= 8) && checkFlag(argv[1], "n")) {
+        NetplayConfig config;
+        config.localPort = (Uint16)atoi(argv[2]);
+        config.remoteHost = argv[3];
+        config.remotePort = (Uint16)atoi(argv[4]);
+        config.player = atoi(argv[5]) - 1;
+        if ((config.player != 0) && (config.player != 1)) {
+            fprintf(stderr, "Player must be 1 or 2.\n");
+            return -1;
+        }
+        config.inputDelay = (argc >= 7) ? atoi(argv[6]) : 2;
+        config.readInput = NULL;
+        config.mode = NETPLAY_MODE_SHARED;
+        if ((argc == 8) && (strcmp(argv[7], "spectate") == 0)) {
+            config.mode = NETPLAY_MODE_SPECTATE;
+        }
+        // player 2 gets these from player 1
+        config.gameType = gameType;
+        config.stage = 0;
+        config.seed = (Uint16)(rngVal | (gameFrames << 8));
+        if (!Netplay_Start(&config)) { return -1; }
+    }
     else {
         Task_Init(Title_Run);
     }
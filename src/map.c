@@ -20,27 +20,32 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "constants.h"
 #include "graphics.h"
 #include "map.h"
 #include "object.h"
 #include "palette.h"
+#include "state.h"
 
 MapData *mapData;
+Arena mapArena = ARENA_INIT(ALLOC_TAG_MAP, 64 * 1024);
 Uint16 mapMetatiles[MAP_HEIGHT_METATILES * MAP_WIDTH_METATILES];
 Uint8 currRoom = 0xff;
 static Uint16 scrollX;
 static Uint16 scrollY;
 
-void Map_FreeData(MapData *data) {
-    for (int i = 0; i < data->numTilesets; i++) {
-        free(data->tilesets[i].metatiles);
-    }
-    free(data->tilesets);
-    free(data->chunks);
-    free(data->screens);
-    free(data->warpDoors);
-    free(data);
+void Map_RegisterState(void) {
+    // points to data loaded from the ROM
+    State_Register(&mapData, sizeof(mapData), STATE_NOHASH);
+    State_Register(mapMetatiles, sizeof(mapMetatiles), 0);
+    State_Register(&currRoom, sizeof(currRoom), 0);
+    State_Register(&scrollX, sizeof(scrollX), 0);
+    State_Register(&scrollY, sizeof(scrollY), 0);
+}
+
+void Map_FreeData(void) {
+    Arena_Reset(&mapArena);
 }
 
 
@@ -18,6 +18,7 @@
  */
 
 #pragma once
+#include "alloc.h"
 #include "graphics.h"
 #include "object.h"
 
@@ -96,6 +97,8 @@ typedef struct {
 
 // map data
 extern MapData *mapData;
+// everything in a MapData struct is allocated from here
+extern Arena mapArena;
 
 // current room number
 extern Uint8 currRoom;
@@ -113,10 +116,9 @@ extern Uint8 currRoom;
 extern Uint16 mapMetatiles[MAP_HEIGHT_METATILES * MAP_WIDTH_METATILES];
 
 /**
- * @brief Frees a heap-allocated MapData struct
- * @param data struct to free
+ * @brief Frees every MapData struct that's been loaded
  */
-void Map_FreeData(MapData *data);
+void Map_FreeData(void);
 
 /**
  * @brief Loads a room from the map data
@@ -194,3 +196,8 @@ void Map_SetPos(Uint16 x, Uint16 y);
  * @brief Draws the map to the screen
 */
 void Map_Draw(void);
+
+/**
+ * @brief Adds the current room and scroll position to the game state.
+*/
+void Map_RegisterState(void);
@@ -18,6 +18,7 @@
  */
 
 #include <ctype.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdnoreturn.h>
@@ -29,21 +30,18 @@
 #include "file.h"
 #include "mml.h"
 #include "sound.h"
-
-static FILE *infile;
-
-// used for keeping track of where we are in the input file for error messages
-static int line;
-static int column;
-// gets used instead of reading a character from the input file if it's not NO_CH
-#define NO_CH -2
-static int nextCh;
-// which apu we're using (0 or 1), set by the A command
-static int apu;
-// how many frames (1 frame = 1/60 second) a 16th note (smallest note we support) should take, set by the t command
-static int tempo;
-// default note length, set by the f command
-static int defaultLength;
+#include "util.h"
+#include "writer.h"
+
+// Compiled MML gets cached in the user's data directory. The cache file starts
+// with a header (magic, version, MML file size, modification time as two
+// Uint32s, FNV-1a hash of the MML file), then has the sound's isMusic and
+// instrument count, then for each instrument its number, channel, reg0, reg1,
+// bytecode size, and bytecode. Everything's big endian.
+#define MML_CACHE_MAGIC "OMML"
+// bump this when the bytecode or cache format changes
+#define MML_CACHE_VERSION (1)
+#define MML_CACHE_HEADER_SIZE (24)
 
 // we error out when we hit this cursor number (65535 not 655366 because the sound engine uses a cursor value of 65535
 // as an "instrument not playing" flag)
@@ -78,37 +76,62 @@ typedef struct {
 #define NUM_CHANNELS 4
 // maximum number of instruments the sound engine supports
 #define NUM_INSTRUMENTS 6
-static InstData instruments[NUM_INSTRUMENTS];
 
-static noreturn void errorExit(char *message) {
-    printf("Line %d column %d: %s\n", line, column, message);
-    exit(-1);
+// All the compiler's state lives in one of these, so any number of files can
+// be compiled at once.
+typedef struct {
+    // the MML source, which gets scanned in place
+    const char *start;
+    const char *read;
+    const char *end;
+    // used for keeping track of where we are in the input file for error messages
+    int line;
+    int column;
+    // which apu we're using (0 or 1), set by the A command
+    int apu;
+    // how many frames (1 frame = 1/60 second) a 16th note (smallest note we support) should take, set by the t command
+    int tempo;
+    // default note length, set by the f command
+    int defaultLength;
+    InstData instruments[NUM_INSTRUMENTS];
+    MMLErrors *errors;
+    // where the compiled sound gets allocated from
+    Arena *arena;
+    // where to go when there's an error
+    jmp_buf errorJump;
+} MMLCompiler;
+
+// records the error and goes back to the main loop, which skips to the next line
+static noreturn void error(MMLCompiler *c, char *message) {
+    MMLErrors *errors = c->errors;
+    if (errors->count < MML_MAX_ERRORS) {
+        snprintf(errors->messages[errors->count], sizeof(errors->messages[0]),
+                 "%s line %d column %d: %s", errors->name, c->line, c->column, message);
+    }
+    errors->count++;
+    longjmp(c->errorJump, 1);
 }
 
-static void initInstrument(int num) {
-    instruments[num].enabled = 1;
-    instruments[num].outBuff = Buffer_Init(256);
-    instruments[num].cursor = 0;
-    instruments[num].loopPoint = -1;
-    instruments[num].loopPos = -1;
-    instruments[num].channel = -1;
-    instruments[num].reg1 = -1;
-    instruments[num].reg0 = -1;
-    instruments[num].octave = -1;
-    instruments[num].frames = 0;
-    instruments[num].loopFrames = 0;
+static void initInstrument(MMLCompiler *c, int num) {
+    InstData *inst = &c->instruments[num];
+    inst->enabled = 1;
+    inst->outBuff = Buffer_Init(256);
+    inst->cursor = 0;
+    inst->loopPoint = -1;
+    inst->loopPos = -1;
+    inst->channel = -1;
+    inst->reg1 = -1;
+    inst->reg0 = -1;
+    inst->octave = -1;
+    inst->frames = 0;
+    inst->loopFrames = 0;
 }
 
-static void nextLine(void) {
-    int ch;
-    while (1) {
-        ch = getc(infile);
-        if ((ch == EOF) || (ch == '\n')) {
-            break;
-        }
-    }
-    column = 0;
-    line++;
+static void nextLine(MMLCompiler *c) {
+    const char *newline = memchr(c->read, '\n', c->end - c->read);
+    c->read = newline ? (newline + 1) : c->end;
+    c->column = 0;
+    c->line++;
 }
 
 /**
@@ -116,137 +139,123 @@ static void nextLine(void) {
  * @param whitespace nonzero if you want to get whitespace, 0 if you want to skip whitespace
  * @returns the next character from the file
  */
-static int readCh(int whitespace) {
-    int ch;
-
-    while (1) {
-        if (nextCh != NO_CH) {
-            ch = nextCh;
-            nextCh = NO_CH;
-        }
-        else {
-            ch = getc(infile);
-        }
+static int readCh(MMLCompiler *c, int whitespace) {
+    while (c->read < c->end) {
+        int ch = (unsigned char)*c->read++;
         if (ch == '\n') {
-            column = 0;
-            line++;
+            c->column = 0;
+            c->line++;
         }
-        else { column++; }
-        if ((ch == EOF) || whitespace || !isspace(ch)) { break; }
+        else { c->column++; }
+        if (whitespace || !isspace(ch)) { return ch; }
     }
-    return ch;
+    return EOF;
 }
 
-static void pushCh(int ch) {
-    nextCh = ch;
-    column--;
+// un-reads the character that readCh just returned
+static void pushCh(MMLCompiler *c, int ch) {
+    if (ch == EOF) { return; }
+    c->read--;
+    if (ch == '\n') { c->line--; }
+    else { c->column--; }
 }
 
-static int readNum(void) {
-    char numStr[5] = {0};
-    int numCursor = 0;
+static int readNum(MMLCompiler *c) {
+    int num = 0;
+    int digits = 0;
 
-    // leave space for null terminator
-    while (numCursor < (ARRAY_LEN(numStr) - 1)) {
-        int ch = readCh(0);
+    while (1) {
+        int ch = readCh(c, 0);
         if (isdigit(ch)) {
-            numStr[numCursor++] = (char)ch;
+            if (digits == 3) { error(c, "Number too large"); }
+            num = (num * 10) + (ch - '0');
+            digits++;
         }
         else {
-            pushCh(ch);
-            if (numCursor == 0) {
-                return EOF;
-            }
-            else {
-                return atoi(numStr);
-            }
+            pushCh(c, ch);
+            return digits ? num : EOF;
         }
     }
-    errorExit("Number too large");
 }
 
-static int readHex(void) {
-    char hexStr[3] = {0};
-    int hexCursor = 0;
+static int readHex(MMLCompiler *c) {
+    int num = 0;
+    int digits = 0;
 
-    while (hexCursor < (ARRAY_LEN(hexStr) - 1)) {
+    while (digits < 2) {
         // we care about whitespace because some note commands are also valid hex digits so we want a space to
         // terminate the hex string
-        int ch = readCh(1);
+        int ch = readCh(c, 1);
         if (isxdigit(ch)) {
-            hexStr[hexCursor++] = (char)ch;
+            num = (num << 4) | (isdigit(ch) ? (ch - '0') : ((tolower(ch) - 'a') + 10));
+            digits++;
         }
         else {
-            pushCh(ch);
+            pushCh(c, ch);
             break;
         }
     }
-    if (hexCursor == 0) {
-        return EOF;
-    }
-    else {
-        return (int)strtol(hexStr, NULL, 16);
-    }
+    return digits ? num : EOF;
 }
 
-static int getNoteFrames(int noteNum) {
+static int getNoteFrames(MMLCompiler *c, int noteNum) {
     // valid notes: powers of 2 between 1 and 16
     if ((noteNum >= 1) && (noteNum <= 16) && ((noteNum & (noteNum - 1)) == 0)) {
-        int frames = tempo * (16 / noteNum);
+        int frames = c->tempo * (16 / noteNum);
         // handle dotted notes
         int originalNote = frames;
         int ch;
         for (int i = 0; i < 3; i++) {
-            ch = readCh(0);
+            ch = readCh(c, 0);
             if (ch == '.') {
                 originalNote /= 2;
                 frames += originalNote;
             }
             else {
-                pushCh(ch);
+                pushCh(c, ch);
                 return frames;
             }
         }
-        errorExit("Too many dots on note (max 3)");
+        error(c, "Too many dots on note (max 3)");
     }
     else {
-        errorExit("Invalid note duration");
+        error(c, "Invalid note duration");
     }
 }
 
-static int noteToFrames(void) {
-    if (tempo <= 0) { errorExit("Tempo must be set with t command"); }
-    int noteNum = readNum();
+static int noteToFrames(MMLCompiler *c) {
+    if (c->tempo <= 0) { error(c, "Tempo must be set with t command"); }
+    int noteNum = readNum(c);
     if (noteNum < 0) {
-        if (defaultLength > 0) {
-            return defaultLength;
+        if (c->defaultLength > 0) {
+            return c->defaultLength;
         }
         else {
-            errorExit("Default note length must be set with l command");
+            error(c, "Default note length must be set with l command");
         }
     }
-    int frames = getNoteFrames(noteNum);
+    int frames = getNoteFrames(c, noteNum);
     // handle tie(s)
-    int ch = readCh(0);
+    int ch = readCh(c, 0);
     while (ch == '^') {
-        noteNum = readNum();
+        noteNum = readNum(c);
         if (noteNum < 0) {
-            errorExit("Note not specified for tie");
+            error(c, "Note not specified for tie");
         }
         else {
-            frames += getNoteFrames(noteNum);
+            frames += getNoteFrames(c, noteNum);
         }
-	ch = readCh(0);
+        ch = readCh(c, 0);
     }
-    pushCh(ch);
+    pushCh(c, ch);
     if (frames >= 65536) {
-        errorExit("Note duration too long (max: 65535 frames)");
+        error(c, "Note duration too long (max: 65535 frames)");
     }
     return frames;
 }
 
-static void checkInst(InstData *i) {
-    if (!i) { errorExit("Instrument number must be defined with the I command."); }
+static void checkInst(MMLCompiler *c, InstData *i) {
+    if (!i) { error(c, "Instrument number must be defined with the I command."); }
 }
 
 static void addInstFrames(InstData *i, int frames) {
@@ -258,100 +267,101 @@ static void addInstFrames(InstData *i, int frames) {
     }
 }
 
-static void writeCmd(InstData *i, Uint8 cmd, Uint16 param) {
-    checkInst(i);
-    if (apu < 0) { errorExit("APU number must be set with A command"); }
-    if ((i->reg0 < 0) || (i->reg1 < 0)) { errorExit("APU registers 0 & 1 must be initialized with R0 & R1 commands"); }
-    if (i->channel < 0) { errorExit("APU channel must be initialized with C command"); }
+static void writeCmd(MMLCompiler *c, InstData *i, Uint8 cmd, Uint16 param) {
+    checkInst(c, i);
+    if (c->apu < 0) { error(c, "APU number must be set with A command"); }
+    if ((i->reg0 < 0) || (i->reg1 < 0)) { error(c, "APU registers 0 & 1 must be initialized with R0 & R1 commands"); }
+    if (i->channel < 0) { error(c, "APU channel must be initialized with C command"); }
+    if (i->cursor >= CURSOR_LIMIT) { error(c, "Song too long"); }
     Buffer_Add(i->outBuff, cmd);
     Buffer_AddUint16(i->outBuff, param);
     i->cursor++;
-    if (i->cursor >= CURSOR_LIMIT) { errorExit("Song too long"); }
 }
 
-int MML_Compile(const char *filename, Sound *sound){
-    // input file
-    infile = File_OpenResource(filename, "r");
-    if (!infile) {
-        return 0;
-    }
-    printf("--- Compiling %s ---\n", filename);
-
+// Compiles the source in c to sound, and writes the compiled data to cache (see
+// MML_LoadCache) if it isn't NULL. Returns zero if there were errors.
+static int MML_Run(MMLCompiler *c, Sound *sound, Buffer *cache) {
     // initialize compiler state
-    line = 1;
-    column = 0;
-    nextCh = NO_CH;
-    apu = -1;
-    tempo = -1;
-    defaultLength = -1;
+    c->line = 1;
+    c->column = 0;
+    c->apu = -1;
+    c->tempo = -1;
+    c->defaultLength = -1;
+    memset(c->instruments, 0, sizeof(c->instruments));
 
     int ch;
     int note;
     int frames;
-    int numNoises = 0;
     Uint8 noiseList[256];
-    int instNum;
-    InstData *inst = NULL;
-    while (!feof(infile)) {
-        ch = readCh(0);
+    // volatile because they're changed between setjmp and longjmp
+    volatile int numNoises = 0;
+    volatile int instNum = -1;
+    InstData *volatile inst = NULL;
+
+    // skip the rest of the line when there's an error, as long as it isn't
+    // the last line. past MML_MAX_ERRORS, errors are still counted but their
+    // messages are dropped.
+    if (setjmp(c->errorJump)) {
+        if (c->read >= c->end) { goto done; }
+        if ((c->read > c->start) && (c->read[-1] != '\n')) { nextLine(c); }
+    }
+    while ((ch = readCh(c, 0)) != EOF) {
         switch (ch) {
-        case EOF: break;
-
         // comment
         case ';':
-            nextLine();
+            nextLine(c);
             break;
 
         // loop start
         case '[':
-            checkInst(inst);
+            checkInst(c, inst);
             if (inst->loopPos < 0) {
                 inst->loopPos = inst->cursor;
             }
             else {
-                errorExit("Nested loops aren't allowed");
+                error(c, "Nested loops aren't allowed");
             }
             break;
 
         // loop end
         case ']':
-            checkInst(inst);
+            checkInst(c, inst);
             if (inst->loopPos >= 0) {
-                int loopCount = readNum();
+                int loopCount = readNum(c);
                 if ((loopCount >= 2) && (loopCount <= 16)) {
                     // b0 = loop command
-                    writeCmd(inst, 0xb0 | (loopCount - 2), inst->loopPos);
+                    writeCmd(c, inst, 0xb0 | (loopCount - 2), inst->loopPos);
                     inst->loopPos = -1;
                     inst->frames += (inst->loopFrames * loopCount);
                     inst->loopFrames = 0;
                 }
                 else {
-                    errorExit("Loop count must be between 2 and 16");
+                    error(c, "Loop count must be between 2 and 16");
                 }
             }
             break;
 
         // up octave
         case '>':
-            checkInst(inst);
+            checkInst(c, inst);
             if ((inst->octave >= 1) && (inst->octave <= 8)) {
                 inst->octave++;
-                if (inst->octave > 8) { errorExit("Octave must be between 1 and 8"); }
+                if (inst->octave > 8) { error(c, "Octave must be between 1 and 8"); }
             }
             else {
-                errorExit("Octave must be initialized with o command");
+                error(c, "Octave must be initialized with o command");
             }
             break;
 
         // down octave
         case '<':
-            checkInst(inst);
+            checkInst(c, inst);
             if ((inst->octave >= 1) && (inst->octave <= 8)) {
                 inst->octave--;
-                if (inst->octave < 1) { errorExit("Octave must be between 1 and 8"); }
+                if (inst->octave < 1) { error(c, "Octave must be between 1 and 8"); }
             }
             else {
-                errorExit("Octave must be initialized with o command");
+                error(c, "Octave must be initialized with o command");
             }
             break;
 
@@ -371,46 +381,46 @@ int MML_Compile(const char *filename, Sound *sound){
         case 'b':
             note = 11;
         doneNote:;
-            checkInst(inst);
-            int sharp = readCh(0);
+            checkInst(c, inst);
+            int sharp = readCh(c, 0);
             if (sharp == '#') {
                 sharp = 1;
                 if ((ch == 'e') || (ch == 'b')) {
-                    errorExit("Only c#, d#, f#, g#, and a# are permitted sharp notes");
+                    error(c, "Only c#, d#, f#, g#, and a# are permitted sharp notes");
                 }
             }
             else {
-                pushCh(sharp);
+                pushCh(c, sharp);
                 sharp = 0;
             }
             note += sharp;
-            frames = noteToFrames();
-            writeCmd(inst, (inst->octave - 1) << 4 | note, frames);
+            frames = noteToFrames(c);
+            writeCmd(c, inst, (inst->octave - 1) << 4 | note, frames);
             addInstFrames(inst, frames);
             break;
 
         // APU number
         case 'A':
-            if (apu >= 0) { errorExit("APU number can't be changed"); }
-            int apuNum = readNum();
+            if (c->apu >= 0) { error(c, "APU number can't be changed"); }
+            int apuNum = readNum(c);
             if ((apuNum == 0) || (apuNum == 1)) {
-                apu = apuNum;
+                c->apu = apuNum;
             }
             else {
-                errorExit("APU number must be 0 or 1");
+                error(c, "APU number must be 0 or 1");
             }
             break;
 
         // APU channel number
         case 'C':
-            checkInst(inst);
-            int channelNum = readNum();
+            checkInst(c, inst);
+            int channelNum = readNum(c);
             if ((channelNum >= 0) && (channelNum < NUM_CHANNELS)) {
-                if (inst->channel >= 0) { errorExit("APU channel can't be changed"); }
+                if (inst->channel >= 0) { error(c, "APU channel can't be changed"); }
                 inst->channel = channelNum;
             }
             else {
-                errorExit("Channel number must be between 0 and 3");
+                error(c, "Channel number must be between 0 and 3");
             }
             break;
 
@@ -420,34 +430,35 @@ int MML_Compile(const char *filename, Sound *sound){
             if (inst && inst->frames && (inst->loopPos == -1)) {
                 printf("Instrument %d: %d frames\n", instNum, inst->frames);
             }
-            instNum = readNum();
-            if ((instNum >= 0) && (instNum < NUM_INSTRUMENTS)) {
-                inst = &instruments[instNum];
+            int newInstNum = readNum(c);
+            if ((newInstNum >= 0) && (newInstNum < NUM_INSTRUMENTS)) {
+                instNum = newInstNum;
+                inst = &c->instruments[instNum];
                 if (!inst->enabled) {
-                    initInstrument(instNum);
+                    initInstrument(c, instNum);
                 }
             }
             else {
-                errorExit("Instrument number must be between 0 and 5");
+                error(c, "Instrument number must be between 0 and 5");
             }
             break;
 
         // loop point
         case 'L':
-            checkInst(inst);
+            checkInst(c, inst);
             inst->loopPoint = inst->cursor;
             break;
 
         // default note length
         case 'l':
-            defaultLength = noteToFrames();
+            c->defaultLength = noteToFrames(c);
             break;
 
         // adds noise to list
         case 'N':;
-            int noiseToAdd = readHex();
+            int noiseToAdd = readHex(c);
             if ((noiseToAdd <= 0) || (noiseToAdd >= 0xff) || ((noiseToAdd >= 0xa0) && (noiseToAdd < 0xc0))) {
-                errorExit("Noise must be 0-a0 or c0-fe");
+                error(c, "Noise must be 0-a0 or c0-fe");
             }
             int noiseFound = 0;
             for (int i = 0; i < numNoises; i++) {
@@ -463,47 +474,47 @@ int MML_Compile(const char *filename, Sound *sound){
 
         // plays noise
         case 'n':
-            checkInst(inst);
-            if (inst->channel != 3) { errorExit("Noise can only be played on APU channel 3"); }
-            int noiseToPlay = readNum();
+            checkInst(c, inst);
+            if (inst->channel != 3) { error(c, "Noise can only be played on APU channel 3"); }
+            int noiseToPlay = readNum(c);
             if ((noiseToPlay < 0) || (noiseToPlay >= numNoises)) {
-                errorExit("Invalid noise number");
+                error(c, "Invalid noise number");
             }
-            ch = readCh(0);
+            ch = readCh(c, 0);
             if (ch == ',') {
-                frames = noteToFrames();
+                frames = noteToFrames(c);
             }
             else {
-                frames = defaultLength;
-                pushCh(ch);
+                frames = c->defaultLength;
+                pushCh(c, ch);
             }
-            writeCmd(inst, noiseList[noiseToPlay], frames);
+            writeCmd(c, inst, noiseList[noiseToPlay], frames);
             addInstFrames(inst, frames);
             break;
 
         // octave specifier
         case 'o':
-            checkInst(inst);
-            inst->octave = readNum();
+            checkInst(c, inst);
+            inst->octave = readNum(c);
             if ((inst->octave < 1) || (inst->octave > 8)) {
-                errorExit("Octave must be between 1 and 8");
+                error(c, "Octave must be between 1 and 8");
             }
             break;
 
         // register set
         case 'R':;
-            checkInst(inst);
-            int regNum = readNum();
+            checkInst(c, inst);
+            int regNum = readNum(c);
             if ((regNum != 0) && (regNum != 1)) {
-                errorExit("Register to set must be 0 or 1");
+                error(c, "Register to set must be 0 or 1");
             }
-            ch = readCh(0);
+            ch = readCh(c, 0);
             if ((ch != ',') && (ch != ':')) {
-                errorExit("Register value not specified");
+                error(c, "Register value not specified");
             }
-            int regVal = readHex();
+            int regVal = readHex(c);
             if ((regVal < 0) || (regVal > 255)) {
-                errorExit("Invalid register value");
+                error(c, "Invalid register value");
             }
             if ((regNum == 0) && (inst->reg0 < 0)) {
                 inst->reg0 = regVal;
@@ -512,73 +523,245 @@ int MML_Compile(const char *filename, Sound *sound){
                 inst->reg1 = regVal;
             }
             else {
-                writeCmd(inst, 0xa0 + regNum, regVal);
+                writeCmd(c, inst, 0xa0 + regNum, regVal);
             }
             break;
 
         // rest
         case 'r':
-            frames = noteToFrames();
-            writeCmd(inst, 0x6f, frames);
+            frames = noteToFrames(c);
+            writeCmd(c, inst, 0x6f, frames);
             addInstFrames(inst, frames);
             break;
 
         // tempo specifier (how many frames a 16th note takes)
         case 't':
-            tempo = readNum();
-            if (tempo <= 0) {
-                errorExit("Tempo must be greater than 0");
+            c->tempo = readNum(c);
+            if (c->tempo <= 0) {
+                error(c, "Tempo must be greater than 0");
             }
             break;
 
         // we shouldn't end up here
         default:
-            errorExit("Syntax error");
+            error(c, "Syntax error");
         }
     }
 
-    fclose(infile);
-
     // print frame count for final instrument statement
     if (inst) {
         printf("Instrument %d: %d frames\n", instNum, inst->frames);
     }
 
-    memset(sound, 0, sizeof(Sound));
-    sound->isMusic = apu;
-
-    // finish up the instrument data
+    // finish up the instrument data (errors here are reported at the end of the file)
     for (int i = 0; i < NUM_INSTRUMENTS; i++) {
-        inst = &instruments[i];
-        if (inst->enabled) {
-            if (inst->loopPoint >= 0) {
-                writeCmd(inst, 0xbf, inst->loopPoint);
+        InstData *finish = &c->instruments[i];
+        if (finish->enabled) {
+            if (finish->loopPoint >= 0) {
+                writeCmd(c, finish, 0xbf, finish->loopPoint);
             }
             // "end of track" command
             else {
-                writeCmd(inst, 0xff, 0x00);
+                writeCmd(c, finish, 0xff, 0x00);
             }
-            sound->count++;
         }
     }
+
+done:
+    if (c->errors->count) {
+        for (int i = 0; i < NUM_INSTRUMENTS; i++) {
+            if (c->instruments[i].enabled) { Buffer_Destroy(c->instruments[i].outBuff); }
+        }
+        return 0;
+    }
+
+    memset(sound, 0, sizeof(Sound));
+    sound->isMusic = c->apu;
+    for (int i = 0; i < NUM_INSTRUMENTS; i++) {
+        if (c->instruments[i].enabled) { sound->count++; }
+    }
     // write out the instrument data so the sound engine can read it
-    sound->data = ommalloc(sound->count * sizeof(Instrument));
+    sound->data = Arena_Alloc(c->arena, sound->count * sizeof(Instrument));
+    if (cache) {
+        Buffer_Add(cache, sound->isMusic);
+        Buffer_Add(cache, sound->count);
+    }
     int count = 0;
     for (int i = 0; i < NUM_INSTRUMENTS; i++) {
-        inst = &instruments[i];
-        if (inst->enabled) {
+        InstData *out = &c->instruments[i];
+        if (out->enabled) {
+            if (cache) {
+                Buffer_Add(cache, (Uint8)i);
+                Buffer_Add(cache, (Uint8)out->channel);
+                Buffer_Add(cache, (Uint8)out->reg0);
+                Buffer_Add(cache, (Uint8)out->reg1);
+                Buffer_AddUint32(cache, (Uint32)out->outBuff->dataSize);
+                Buffer_AddData(cache, out->outBuff->data, out->outBuff->dataSize);
+            }
             sound->data[count].num = i;
-            sound->data[count].data = inst->outBuff->data;
-            // Buffer_Destroy frees the data as well, which we don't want to do
-            free(inst->outBuff);
-            sound->data[count].channel = (Uint8)(inst->channel);
+            sound->data[count].channel = (Uint8)(out->channel);
+            sound->data[count].data = Sound_DecodeData(c->arena, out->outBuff->data, out->outBuff->dataSize / 3,
+                                                       sound->data[count].channel);
+            Buffer_Destroy(out->outBuff);
             sound->data[count].cursor = 0;
-            sound->data[count].reg1 = (Uint8)(inst->reg1);
-            sound->data[count].reg0 = (Uint8)(inst->reg0);
+            sound->data[count].reg1 = (Uint8)(out->reg1);
+            sound->data[count].reg0 = (Uint8)(out->reg0);
             count++;
         }
     }
+    return 1;
+}
+
+int MML_CompileBuffer(const char *name, const char *data, int size, Sound *sound, Arena *arena, MMLErrors *errors) {
+    MMLCompiler c;
+    c.arena = arena;
+    c.start = data;
+    c.read = data;
+    c.end = data + size;
+    c.errors = errors;
+    errors->name = name;
+    errors->count = 0;
+    return MML_Run(&c, sound, NULL);
+}
+
+static Uint32 MML_Hash(const Uint8 *data, int size) {
+    Uint32 hash = 2166136261u;
+    for (int i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    memset(instruments, 0, sizeof(instruments));
+// the cache file for "mml/mus_title.mml" is "mml_mus_title.mml.cache"
+static void MML_CacheName(const char *filename, char *out, size_t len) {
+    snprintf(out, len, "%s.cache", filename);
+    for (char *c = out; *c; c++) {
+        if ((*c == '/') || (*c == '\\') || (*c == ':')) { *c = '_'; }
+    }
+}
+
+static void MML_WriteCacheHeader(Buffer *buf, Uint32 size, uint64_t mtime, Uint32 hash) {
+    Buffer_AddData(buf, (Uint8 *)MML_CACHE_MAGIC, 4);
+    Buffer_AddUint32(buf, MML_CACHE_VERSION);
+    Buffer_AddUint32(buf, size);
+    Buffer_AddUint32(buf, (Uint32)(mtime >> 32));
+    Buffer_AddUint32(buf, (Uint32)mtime);
+    Buffer_AddUint32(buf, hash);
+}
+
+// returns the cache file's contents if it's for an MML file of the given size
+static Uint8 *MML_ReadCache(const char *cacheName, Uint32 size, int *cacheSize) {
+    FILE *fp = File_Open(cacheName, "rb");
+    if (!fp) { return NULL; }
+    Uint8 *cache = File_Load(fp, cacheSize);
+    fclose(fp);
+    if ((*cacheSize < MML_CACHE_HEADER_SIZE) || memcmp(cache, MML_CACHE_MAGIC, 4) ||
+        (Util_LoadUint32(cache + 4) != MML_CACHE_VERSION) || (Util_LoadUint32(cache + 8) != size)) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+static uint64_t MML_CacheTime(Uint8 *cache) {
+    return ((uint64_t)Util_LoadUint32(cache + 12) << 32) | Util_LoadUint32(cache + 16);
+}
+
+// returns zero if the cache data is malformed
+static int MML_LoadCache(Uint8 *cache, int cacheSize, Sound *sound, Arena *arena) {
+    Uint8 *data = cache + MML_CACHE_HEADER_SIZE;
+    Uint8 *end = cache + cacheSize;
+    if ((end - data) < 2) { return 0; }
+    memset(sound, 0, sizeof(Sound));
+    sound->isMusic = *data++;
+    sound->count = *data++;
+    if (sound->count > NUM_INSTRUMENTS) { return 0; }
+    sound->data = Arena_Alloc(arena, sound->count * sizeof(Instrument));
+    memset(sound->data, 0, sound->count * sizeof(Instrument));
+    for (int i = 0; i < sound->count; i++) {
+        Instrument *inst = &sound->data[i];
+        if ((end - data) < 8) { goto error; }
+        inst->num = *data++;
+        inst->channel = *data++;
+        inst->reg0 = *data++;
+        inst->reg1 = *data++;
+        Uint32 recordSize = Util_LoadUint32(data);
+        data += 4;
+        if ((recordSize > (Uint32)(end - data)) || (recordSize % 3)) { goto error; }
+        inst->data = Sound_DecodeData(arena, data, recordSize / 3, inst->channel);
+        data += recordSize;
+    }
     return 1;
+
+error:
+    // whatever got decoded stays in the arena, but this only happens
+    // if the cache file is corrupted
+    memset(sound, 0, sizeof(Sound));
+    return 0;
+}
+
+int MML_Compile(const char *filename, Sound *sound, Arena *arena) {
+    FILE *fp = File_OpenResource(filename, "rb");
+    if (!fp) {
+        return 0;
+    }
+
+    // the cache is tied to the MML file's size, modification time, and contents
+    Uint32 size = 0;
+    uint64_t mtime = 0;
+    char cacheName[512];
+    MML_CacheName(filename, cacheName, sizeof(cacheName));
+    int cacheSize = 0;
+    Uint8 *cache = NULL;
+    if (File_GetInfo(fp, &size, &mtime)) {
+        cache = MML_ReadCache(cacheName, size, &cacheSize);
+    }
+    // if the file hasn't been touched, there's no need to read it at all
+    if (cache && (MML_CacheTime(cache) == mtime) && MML_LoadCache(cache, cacheSize, sound, arena)) {
+        free(cache);
+        fclose(fp);
+        return 1;
+    }
+
+    // otherwise, the cache is still good if the contents are the same
+    int sourceSize;
+    Uint8 *source = File_Load(fp, &sourceSize);
+    fclose(fp);
+    Uint32 hash = MML_Hash(source, sourceSize);
+
+    Buffer *out = Buffer_Init(1024);
+    MML_WriteCacheHeader(out, size, mtime, hash);
+    int ok = 1;
+    if (cache && (Util_LoadUint32(cache + 20) == hash) && MML_LoadCache(cache, cacheSize, sound, arena)) {
+        Buffer_AddData(out, cache + MML_CACHE_HEADER_SIZE, cacheSize - MML_CACHE_HEADER_SIZE);
+    }
+    else {
+        printf("--- Compiling %s ---\n", filename);
+        MMLCompiler c;
+        MMLErrors errors;
+        c.start = (const char *)source;
+        c.read = c.start;
+        c.end = c.start + sourceSize;
+        c.errors = &errors;
+        c.arena = arena;
+        errors.name = filename;
+        errors.count = 0;
+        ok = MML_Run(&c, sound, out);
+        for (int i = 0; i < MIN(errors.count, MML_MAX_ERRORS); i++) {
+            printf("%s\n", errors.messages[i]);
+        }
+        if (errors.count > MML_MAX_ERRORS) {
+            printf("%s: %d more errors\n", filename, errors.count - MML_MAX_ERRORS);
+        }
+    }
+    free(cache);
+    free(source);
+
+    // not being able to write the cache isn't a problem, it'll just compile again next time
+    if (ok) {
+        Writer_Write(cacheName, out->data, out->dataSize);
+    }
+    Buffer_Destroy(out);
+    return ok;
 }
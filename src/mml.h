@@ -20,10 +20,38 @@
 #pragma once
 #include "sound.h"
 
+// only this many error messages get kept, any errors after that are still
+// counted but their messages get dropped
+#define MML_MAX_ERRORS (32)
+
+typedef struct {
+    // the name used in error messages
+    const char *name;
+    // total number of errors, only the first MML_MAX_ERRORS have messages
+    int count;
+    char messages[MML_MAX_ERRORS][128];
+} MMLErrors;
+
 /**
- * @brief Compiles the given MML file to bytecode
+ * @brief Compiles the given MML file to bytecode, or loads it from the cache if
+ * it's already been compiled. Any errors get printed.
  * @param filename MML file to compile
  * @param sound (out) where to write the sound metadata and bytecode (see sound.h)
+ * @param arena where to allocate the bytecode from
  * @returns 1 on successful compile, 0 on failed compile
  */
-int MML_Compile(const char *filename, Sound *sound);
+int MML_Compile(const char *filename, Sound *sound, Arena *arena);
+
+/**
+ * @brief Compiles MML source that's already in memory. Doesn't touch any
+ * global state, so it can be run on multiple threads at once as long as each
+ * thread uses its own arena.
+ * @param name name to use in error messages
+ * @param data the MML source (doesn't have to be null terminated)
+ * @param size size of the MML source in bytes
+ * @param sound (out) where to write the sound metadata and bytecode
+ * @param arena where to allocate the bytecode from
+ * @param errors (out) where to write any errors to
+ * @returns 1 on successful compile, 0 if there were errors
+ */
+int MML_CompileBuffer(const char *name, const char *data, int size, Sound *sound, Arena *arena, MMLErrors *errors);
@@ -0,0 +1,132 @@
+/* net.c: UDP socket wrapper
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// needed for getaddrinfo
+#define _POSIX_C_SOURCE 200809L
+// first because it contains the OM_UNIX/OM_WINDOWS defines
+#include "constants.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef OM_WINDOWS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET NetHandle;
+#define NET_INVALID INVALID_SOCKET
+#define NET_CLOSE closesocket
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int NetHandle;
+#define NET_INVALID (-1)
+#define NET_CLOSE close
+#endif
+
+#include "alloc.h"
+#include "net.h"
+
+struct NetSocket {
+    NetHandle handle;
+};
+
+static int Net_Startup(void) {
+#ifdef OM_WINDOWS
+    static int started = 0;
+    if (!started) {
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) { return 0; }
+        started = 1;
+    }
+#endif
+    return 1;
+}
+
+NetSocket *Net_Open(Uint16 port) {
+    if (!Net_Startup()) { return NULL; }
+    NetHandle handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (handle == NET_INVALID) { return NULL; }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(handle, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        NET_CLOSE(handle);
+        return NULL;
+    }
+
+#ifdef OM_WINDOWS
+    u_long nonBlocking = 1;
+    ioctlsocket(handle, FIONBIO, &nonBlocking);
+#else
+    fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+    NetSocket *sock = ommalloc(sizeof(NetSocket));
+    sock->handle = handle;
+    return sock;
+}
+
+void Net_Close(NetSocket *sock) {
+    NET_CLOSE(sock->handle);
+    free(sock);
+}
+
+int Net_Resolve(const char *host, Uint16 port, NetAddr *out) {
+    if (!Net_Startup()) { return 0; }
+    struct addrinfo hints;
+    struct addrinfo *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0) { return 0; }
+    out->host = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+    out->port = htons(port);
+    freeaddrinfo(result);
+    return 1;
+}
+
+void Net_Send(NetSocket *sock, NetAddr *to, Uint8 *data, int len) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = to->host;
+    addr.sin_port = to->port;
+    // UDP is unreliable anyway, so callers have to deal with lost packets
+    sendto(sock->handle, (const char *)data, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+int Net_Recv(NetSocket *sock, NetAddr *from, Uint8 *data, int len) {
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    int count = (int)recvfrom(sock->handle, (char *)data, len, 0, (struct sockaddr *)&addr, &addrLen);
+    if (count <= 0) { return 0; }
+    from->host = addr.sin_addr.s_addr;
+    from->port = addr.sin_port;
+    return count;
+}
+
+int Net_AddrEqual(NetAddr *a, NetAddr *b) {
+    return (a->host == b->host) && (a->port == b->port);
+}
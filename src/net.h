@@ -0,0 +1,75 @@
+/* net.h: UDP socket wrapper
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+
+// IPv4 address, both fields in network byte order
+typedef struct {
+    Uint32 host;
+    Uint16 port;
+} NetAddr;
+
+typedef struct NetSocket NetSocket;
+
+/**
+ * @brief Opens a non-blocking UDP socket.
+ * @param port local port to bind to, 0 = let the OS pick one
+ * @returns the socket, or NULL on failure
+ */
+NetSocket *Net_Open(Uint16 port);
+
+/**
+ * @brief Closes a socket opened with Net_Open.
+ * @param sock the socket
+ */
+void Net_Close(NetSocket *sock);
+
+/**
+ * @brief Looks up a host name or dotted IPv4 address.
+ * @param host the host to look up
+ * @param port port number
+ * @param out where to put the address
+ * @returns nonzero on success, zero on failure
+ */
+int Net_Resolve(const char *host, Uint16 port, NetAddr *out);
+
+/**
+ * @brief Sends a datagram.
+ * @param sock the socket
+ * @param to where to send it
+ * @param data datagram contents
+ * @param len datagram length
+ */
+void Net_Send(NetSocket *sock, NetAddr *to, Uint8 *data, int len);
+
+/**
+ * @brief Receives a datagram without blocking.
+ * @param sock the socket
+ * @param from where to put the sender's address
+ * @param data where to put the datagram
+ * @param len size of data
+ * @returns the datagram length, or 0 if there wasn't one waiting
+ */
+int Net_Recv(NetSocket *sock, NetAddr *from, Uint8 *data, int len);
+
+/**
+ * @returns nonzero if the two addresses are the same
+ */
+int Net_AddrEqual(NetAddr *a, NetAddr *b);
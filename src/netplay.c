@@ -0,0 +1,414 @@
+/* netplay.c: Two player rollback netplay
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "buffer.h"
+#include "constants.h"
+#include "game.h"
+#include "graphics.h"
+#include "joy.h"
+#include "net.h"
+#include "netplay.h"
+#include "platform.h"
+#include "rng.h"
+#include "sound.h"
+#include "state.h"
+#include "task.h"
+#include "util.h"
+
+#define PACKET_HELLO 0
+#define PACKET_INPUT 1
+#define PACKET_HEADER_SIZE 5
+#define MAX_PACKET_SIZE 128
+
+// how many frames of input get kept around (must be a power of 2)
+#define INPUT_RING (128)
+// most input frames that get sent in one packet
+#define MAX_SEND_INPUTS (64)
+// how many snapshots get kept around (must be a power of 2 and more than
+// NETPLAY_MAX_ROLLBACK)
+#define SNAPSHOT_RING (16)
+// how often to compare game state hashes with the other player
+#define HASH_INTERVAL (60)
+#define HASH_RING (8)
+// how often to resend the hello packet while waiting for the other player
+#define HELLO_INTERVAL (30)
+// how often to print stats
+#define STATS_INTERVAL (600)
+
+static NetSocket *sock = NULL;
+static NetAddr remoteAddr;
+static NetplayConfig session;
+static int active = 0;
+static int started = 0;
+static Uint32 waitFrames;
+
+// input for each frame, indexed by frame number & (INPUT_RING - 1)
+static Uint8 localInputs[INPUT_RING];
+static Uint8 remoteInputs[INPUT_RING];
+// what the remote input was predicted to be when the frame was simulated
+static Uint8 predictedInputs[INPUT_RING];
+// number of frames of local input that have been generated
+static Uint32 localCount;
+// number of frames of remote input that have been received
+static Uint32 remoteCount;
+// number of frames of local input the other player has received
+static Uint32 remoteAck;
+// the next frame to simulate
+static Uint32 currFrame;
+// earliest frame with a misprediction
+static int rollbackPending;
+static Uint32 rollbackFrame;
+
+// snapshot taken at the start of each frame
+static Buffer *snapshots[SNAPSHOT_RING];
+
+typedef struct {
+    Uint32 frame;
+    Uint32 hash;
+} NetplayHash;
+static NetplayHash localHashes[HASH_RING];
+static int numLocalHashes;
+static Uint32 nextHashFrame;
+static NetplayHash remoteHash;
+static int haveRemoteHash;
+static int desynced;
+
+static Uint32 statRollbacks;
+static Uint32 statRollbackFrames;
+static int statMaxRollback;
+static Uint32 statStalls;
+
+int Netplay_Start(NetplayConfig *config) {
+    if ((config->inputDelay < 0) || (config->inputDelay > NETPLAY_MAX_DELAY)) {
+        Platform_ShowError("Input delay must be between 0-%d.", NETPLAY_MAX_DELAY);
+        return 0;
+    }
+    if (!Net_Resolve(config->remoteHost, config->remotePort, &remoteAddr)) {
+        Platform_ShowError("Couldn't look up %s.", config->remoteHost);
+        return 0;
+    }
+    sock = Net_Open(config->localPort);
+    if (!sock) {
+        Platform_ShowError("Couldn't open UDP port %d.", config->localPort);
+        return 0;
+    }
+    session = *config;
+    active = 1;
+    started = 0;
+    waitFrames = 0;
+    printf("netplay: waiting for the other player...\n");
+    return 1;
+}
+
+int Netplay_Active(void) {
+    return active;
+}
+
+Uint32 Netplay_GetFrame(void) {
+    return currFrame;
+}
+
+int Netplay_Desynced(void) {
+    return desynced;
+}
+
+static void Netplay_SendHello(void) {
+    Uint8 packet[MAX_PACKET_SIZE];
+    memcpy(packet, "OMNP", 4);
+    packet[4] = PACKET_HELLO;
+    packet[5] = (Uint8)session.player;
+    packet[6] = (Uint8)session.mode;
+    packet[7] = session.gameType;
+    packet[8] = session.stage;
+    Util_SaveUint16(session.seed, packet + 9);
+    Net_Send(sock, &remoteAddr, packet, 11);
+}
+
+static void Netplay_SendInputs(void) {
+    Uint8 packet[MAX_PACKET_SIZE];
+    memcpy(packet, "OMNP", 4);
+    packet[4] = PACKET_INPUT;
+    int cursor = PACKET_HEADER_SIZE;
+    Util_SaveUint32(remoteCount, packet + cursor);
+    cursor += 4;
+    // resend everything the other player hasn't acknowledged, so lost
+    // packets don't need to be handled separately
+    Uint32 start = remoteAck;
+    if ((localCount - start) > MAX_SEND_INPUTS) {
+        start = localCount - MAX_SEND_INPUTS;
+    }
+    Util_SaveUint32(start, packet + cursor);
+    cursor += 4;
+    packet[cursor++] = (Uint8)(localCount - start);
+    for (Uint32 i = start; i < localCount; i++) {
+        packet[cursor++] = localInputs[i & (INPUT_RING - 1)];
+    }
+    if (numLocalHashes) {
+        NetplayHash *hash = &localHashes[(numLocalHashes - 1) % HASH_RING];
+        Util_SaveUint32(hash->frame, packet + cursor);
+        Util_SaveUint32(hash->hash, packet + cursor + 4);
+    }
+    else {
+        // frame 0 never gets hashed, so this means "no hash"
+        Util_SaveUint32(0, packet + cursor);
+        Util_SaveUint32(0, packet + cursor + 4);
+    }
+    cursor += 8;
+    Net_Send(sock, &remoteAddr, packet, cursor);
+}
+
+static void Netplay_CheckHashes(void) {
+    if (!haveRemoteHash || desynced) { return; }
+    int first = (numLocalHashes > HASH_RING) ? (numLocalHashes - HASH_RING) : 0;
+    for (int i = first; i < numLocalHashes; i++) {
+        NetplayHash *hash = &localHashes[i % HASH_RING];
+        if ((hash->frame == remoteHash.frame) && (hash->hash != remoteHash.hash)) {
+            fprintf(stderr, "netplay: desync detected at frame %u\n", hash->frame);
+            desynced = 1;
+            return;
+        }
+    }
+}
+
+static void Netplay_Begin(Uint8 mode, Uint8 gameType, Uint8 stage, Uint16 seed) {
+    session.mode = mode;
+    session.gameType = gameType;
+    session.stage = stage;
+    session.seed = seed;
+
+    Game_StageInit(gameType, stage);
+    rngVal = (Uint8)seed;
+    gameFrames = (Uint8)(seed >> 8);
+    Joy_Inject(0);
+    Task_Init(Game_NetplayTask);
+    if (!State_Init()) {
+        Platform_ShowError("Netplay isn't supported on this system.");
+        Platform_Quit();
+    }
+    Alloc_AllowBegin();
+    for (int i = 0; i < SNAPSHOT_RING; i++) {
+        if (!snapshots[i]) { snapshots[i] = Buffer_Init(64 * 1024); }
+    }
+    Alloc_AllowEnd();
+
+    // the first inputDelay frames don't have any local input
+    memset(localInputs, 0, sizeof(localInputs));
+    memset(remoteInputs, 0, sizeof(remoteInputs));
+    memset(predictedInputs, 0, sizeof(predictedInputs));
+    localCount = session.inputDelay;
+    remoteCount = 0;
+    remoteAck = 0;
+    currFrame = 0;
+    rollbackPending = 0;
+    numLocalHashes = 0;
+    nextHashFrame = HASH_INTERVAL;
+    haveRemoteHash = 0;
+    desynced = 0;
+    started = 1;
+    printf("netplay: connected, game type %d, stage %d, seed %04x\n", gameType, stage + 1, seed);
+}
+
+static void Netplay_HandleInputs(Uint8 *packet, int len) {
+    if (len < (PACKET_HEADER_SIZE + 9)) { return; }
+    int cursor = PACKET_HEADER_SIZE;
+    Uint32 ack = Util_LoadUint32(packet + cursor);
+    cursor += 4;
+    Uint32 start = Util_LoadUint32(packet + cursor);
+    cursor += 4;
+    int count = packet[cursor++];
+    if (len < (cursor + count + 8)) { return; }
+
+    // packets can show up out of order
+    if (ack > remoteAck) { remoteAck = ack; }
+
+    for (int i = 0; i < count; i++) {
+        Uint32 frame = start + i;
+        Uint8 input = packet[cursor + i];
+        // already have this one
+        if (frame < remoteCount) { continue; }
+        // the other player always sends from what we've acknowledged, so this
+        // can only happen if an old packet shows up late
+        if (frame > remoteCount) { break; }
+        remoteInputs[frame & (INPUT_RING - 1)] = input;
+        remoteCount++;
+        // if the frame's already been simulated with the wrong input, it has
+        // to be simulated again
+        if ((frame < currFrame) && (predictedInputs[frame & (INPUT_RING - 1)] != input)) {
+            if (!rollbackPending || (frame < rollbackFrame)) {
+                rollbackPending = 1;
+                rollbackFrame = frame;
+            }
+        }
+    }
+    cursor += count;
+
+    Uint32 hashFrame = Util_LoadUint32(packet + cursor);
+    if (hashFrame) {
+        remoteHash.frame = hashFrame;
+        remoteHash.hash = Util_LoadUint32(packet + cursor + 4);
+        haveRemoteHash = 1;
+        Netplay_CheckHashes();
+    }
+}
+
+static void Netplay_Receive(void) {
+    Uint8 packet[MAX_PACKET_SIZE];
+    NetAddr from;
+    int len;
+    while ((len = Net_Recv(sock, &from, packet, sizeof(packet)))) {
+        if (!Net_AddrEqual(&from, &remoteAddr)) { continue; }
+        if ((len < PACKET_HEADER_SIZE) || memcmp(packet, "OMNP", 4)) { continue; }
+
+        switch (packet[4]) {
+        case PACKET_HELLO:
+            if ((len < 11) || (packet[5] == session.player)) { break; }
+            if (session.player == 0) {
+                // player 1 answers every hello in case its answer got lost
+                Netplay_SendHello();
+                if (!started) {
+                    Netplay_Begin((Uint8)session.mode, session.gameType, session.stage, session.seed);
+                }
+            }
+            else if (!started) {
+                Netplay_Begin(packet[6], packet[7], packet[8], Util_LoadUint16(packet + 9));
+            }
+            break;
+
+        case PACKET_INPUT:
+            // player 2 only sends inputs after getting player 1's hello, so
+            // player 1 can start even if player 2's hellos got lost
+            if (!started && (session.player == 0)) {
+                Netplay_Begin((Uint8)session.mode, session.gameType, session.stage, session.seed);
+            }
+            if (started) {
+                Netplay_HandleInputs(packet, len);
+            }
+            break;
+        }
+    }
+}
+
+// combines both players' inputs into what the game sees
+static Uint32 Netplay_Input(Uint32 frame) {
+    Uint8 local = localInputs[frame & (INPUT_RING - 1)];
+    Uint8 remote;
+    if (frame < remoteCount) {
+        remote = remoteInputs[frame & (INPUT_RING - 1)];
+    }
+    else {
+        remote = remoteCount ? remoteInputs[(remoteCount - 1) & (INPUT_RING - 1)] : 0;
+    }
+    predictedInputs[frame & (INPUT_RING - 1)] = remote;
+
+    if (session.mode == NETPLAY_MODE_SPECTATE) {
+        return (session.player == 0) ? local : remote;
+    }
+    return local | remote;
+}
+
+static void Netplay_Simulate(Uint32 frame, int draw) {
+    State_Save(snapshots[frame & (SNAPSHOT_RING - 1)]);
+    // frames that aren't drawn are being simulated again, and their sounds
+    // already got played the first time
+    Graphics_SetSkip(!draw);
+    Sound_SetSkip(!draw);
+    Graphics_StartFrame();
+    Joy_Inject(Netplay_Input(frame));
+    Joy_Update();
+    Task_Run();
+    Graphics_SetSkip(0);
+    Sound_SetSkip(0);
+}
+
+static void Netplay_PrintStats(void) {
+    printf("netplay: frame %u, %u rollbacks (%u frames, max %d), %u stalls\n",
+           currFrame, statRollbacks, statRollbackFrames, statMaxRollback, statStalls);
+}
+
+void Netplay_Frame(void) {
+    Netplay_Receive();
+
+    if (!started) {
+        // both players send hellos so the relay can find both of them
+        if ((waitFrames % HELLO_INTERVAL) == 0) {
+            Netplay_SendHello();
+        }
+        waitFrames++;
+        return;
+    }
+
+    if (rollbackPending) {
+        int depth = (int)(currFrame - rollbackFrame);
+        State_Load(snapshots[rollbackFrame & (SNAPSHOT_RING - 1)]);
+        for (Uint32 frame = rollbackFrame; frame < currFrame; frame++) {
+            Netplay_Simulate(frame, 0);
+        }
+        rollbackPending = 0;
+        statRollbacks++;
+        statRollbackFrames += depth;
+        if (depth > statMaxRollback) { statMaxRollback = depth; }
+    }
+
+    // once every input before a frame has been received, its state is final
+    // and should match the other player's
+    Uint32 confirmed = MIN(remoteCount, currFrame);
+    if (nextHashFrame <= confirmed) {
+        NetplayHash *hash = &localHashes[numLocalHashes % HASH_RING];
+        hash->frame = nextHashFrame;
+        if (nextHashFrame == currFrame) {
+            hash->hash = State_Hash(NULL);
+        }
+        else {
+            hash->hash = State_Hash(snapshots[nextHashFrame & (SNAPSHOT_RING - 1)]);
+        }
+        numLocalHashes++;
+        nextHashFrame += HASH_INTERVAL;
+        Netplay_CheckHashes();
+    }
+
+    // too far ahead of the other player, wait for them to catch up. The
+    // framebuffer doesn't get cleared, so the last frame stays on screen.
+    // Input gets sent inputDelay frames early, so the other player's input
+    // is usually ahead of the current frame.
+    if ((currFrame > remoteCount) && ((currFrame - remoteCount) >= NETPLAY_MAX_ROLLBACK)) {
+        statStalls++;
+        Netplay_SendInputs();
+        return;
+    }
+
+    // a spectator's input is never used, so leaving it at 0 means player 1
+    // never has to roll back
+    Uint8 input = 0;
+    if ((session.mode != NETPLAY_MODE_SPECTATE) || (session.player == 0)) {
+        input = (Uint8)(session.readInput ? session.readInput(localCount) : Joy_ReadController());
+    }
+    localInputs[localCount & (INPUT_RING - 1)] = input;
+    localCount++;
+    Netplay_SendInputs();
+    Netplay_Simulate(currFrame, 1);
+    currFrame++;
+
+    if ((currFrame % STATS_INTERVAL) == 0) {
+        Netplay_PrintStats();
+    }
+}
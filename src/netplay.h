@@ -0,0 +1,85 @@
+/* netplay.h: Two player rollback netplay
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+
+// How it works: both peers run the same simulation, sending each other their
+// joypad bits for every frame over UDP. When the other peer's input for a
+// frame hasn't shown up yet, it's predicted to be the same as the last one
+// that did. If the real input turns out to be different, the game state is
+// rolled back to that frame and simulated forward again (without drawing)
+// with the corrected inputs. A peer that gets more than NETPLAY_MAX_ROLLBACK
+// frames ahead of the inputs it's received waits for the other peer.
+
+#define NETPLAY_MAX_ROLLBACK (8)
+#define NETPLAY_MAX_DELAY (8)
+
+typedef enum {
+    // both players' inputs control Lucia
+    NETPLAY_MODE_SHARED,
+    // player 1 plays, player 2 watches
+    NETPLAY_MODE_SPECTATE,
+} NETPLAY_MODE;
+
+typedef struct {
+    Uint16 localPort;
+    const char *remoteHost;
+    Uint16 remotePort;
+    // 0 = player 1 (picks the game type, stage, seed, and mode), 1 = player 2
+    int player;
+    // how many frames to delay local input by, trades input lag for fewer rollbacks
+    int inputDelay;
+    // where local input comes from (given the frame it's for), NULL = the controller
+    Uint32 (*readInput)(Uint32 frame);
+    // the rest are only used by player 1
+    int mode;
+    Uint8 gameType;
+    Uint8 stage;
+    Uint16 seed;
+} NetplayConfig;
+
+/**
+ * @brief Opens the netplay socket. The session starts once the other player
+ * connects. Should be run after System_Init.
+ * @param config session settings
+ * @returns nonzero on success, zero on failure
+ */
+int Netplay_Start(NetplayConfig *config);
+
+/**
+ * @returns nonzero if a netplay session has been started
+ */
+int Netplay_Active(void);
+
+/**
+ * @returns the next frame the netplay session is going to simulate
+ */
+Uint32 Netplay_GetFrame(void);
+
+/**
+ * @returns nonzero if the game state stopped matching the other player's
+ */
+int Netplay_Desynced(void);
+
+/**
+ * @brief Runs one frame of the netplay session. Takes the place of
+ * Graphics_StartFrame, Joy_Update and Task_Run in the game loop.
+ */
+void Netplay_Frame(void);
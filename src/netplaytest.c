@@ -0,0 +1,155 @@
+/* netplaytest.c: Netplay loopback test
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// needed for fork, kill, etc
+#define _POSIX_C_SOURCE 200809L
+// first because it contains the OM_UNIX define
+#include "constants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef OM_UNIX
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "game.h"
+#include "graphics.h"
+#include "joy.h"
+#include "nanotime.h"
+#include "netplay.h"
+#include "netplaytest.h"
+#include "platform.h"
+#include "relay.h"
+#include "system.h"
+
+#ifdef OM_UNIX
+#define NSEC_PER_FRAME (NANOTIME_NSEC_PER_SEC / 60)
+// bad enough to cause plenty of rollbacks and resends
+#define RELAY_LATENCY (30)
+#define RELAY_JITTER (15)
+#define RELAY_LOSS (5)
+// how long to keep going after getting to the last frame, so the other player
+// can get any inputs that were lost
+#define LINGER_FRAMES (120)
+
+static Uint8 framebuffer[FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT];
+static int testPlayer;
+
+static Uint32 NetplayTest_Input(Uint32 frame) {
+    // Each player holds a different set of buttons every 16 frames, so the
+    // other player's predictions keep missing. Start isn't used because
+    // pausing would stop anything from happening.
+    Uint32 hash = ((frame / 16) * 2654435761u) ^ ((Uint32)testPlayer * 40503u);
+    return (hash >> 24) & (JOY_LEFT | JOY_RIGHT | JOY_B | JOY_A);
+}
+
+static int NetplayTest_Player(int player, int inputDelay, Uint32 frames) {
+    if (!System_InitHeadless()) { return 0; }
+    Graphics_SetFramebuffer(framebuffer);
+    testPlayer = player;
+
+    NetplayConfig config;
+    config.localPort = 0;
+    config.remoteHost = "127.0.0.1";
+    config.remotePort = (Uint16)(NETPLAYTEST_PORT + player);
+    config.player = player;
+    config.inputDelay = inputDelay;
+    config.readInput = NetplayTest_Input;
+    config.mode = NETPLAY_MODE_SHARED;
+    config.gameType = gameType;
+    config.stage = 0;
+    config.seed = 0x1234;
+    if (!Netplay_Start(&config)) { return 0; }
+
+    // give up if the game runs at less than a quarter of full speed
+    uint64_t start = nanotime_now();
+    uint64_t timeout = ((uint64_t)frames * NSEC_PER_FRAME * 4) + (10 * NANOTIME_NSEC_PER_SEC);
+    uint64_t nextFrame = start;
+    Uint32 linger = 0;
+    while (linger < LINGER_FRAMES) {
+        if (Netplay_GetFrame() >= frames) {
+            linger++;
+        }
+        else if ((nanotime_now() - start) > timeout) {
+            fprintf(stderr, "nettest: player %d stuck at frame %u\n", player + 1, Netplay_GetFrame());
+            return 0;
+        }
+        Netplay_Frame();
+        nextFrame += NSEC_PER_FRAME;
+        uint64_t now = nanotime_now();
+        if (nextFrame > now) { nanotime_sleep(nextFrame - now); }
+    }
+    if (Netplay_Desynced()) {
+        fprintf(stderr, "nettest: player %d desynced\n", player + 1);
+        return 0;
+    }
+    printf("nettest: player %d got to frame %u\n", player + 1, Netplay_GetFrame());
+    return 1;
+}
+#endif
+
+int NetplayTest_Run(int inputDelay, Uint32 frames) {
+#ifdef OM_UNIX
+    if ((inputDelay < 0) || (inputDelay > NETPLAY_MAX_DELAY)) {
+        fprintf(stderr, "Input delay must be between 0-%d.\n", NETPLAY_MAX_DELAY);
+        return 0;
+    }
+    // anything buffered would get printed by every process
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t relay = fork();
+    if (relay < 0) { return 0; }
+    if (relay == 0) {
+        RelayConfig config;
+        config.portA = NETPLAYTEST_PORT;
+        config.portB = NETPLAYTEST_PORT + 1;
+        config.latency = RELAY_LATENCY;
+        config.jitter = RELAY_JITTER;
+        config.loss = RELAY_LOSS;
+        Relay_Run(&config);
+        _exit(1);
+    }
+
+    pid_t player2 = fork();
+    if (player2 < 0) {
+        kill(relay, SIGTERM);
+        waitpid(relay, NULL, 0);
+        return 0;
+    }
+    if (player2 == 0) {
+        exit(NetplayTest_Player(1, inputDelay, frames) ? 0 : 1);
+    }
+
+    int ok = NetplayTest_Player(0, inputDelay, frames);
+    int status;
+    ok = (waitpid(player2, &status, 0) == player2) && WIFEXITED(status) && (WEXITSTATUS(status) == 0) && ok;
+    kill(relay, SIGTERM);
+    waitpid(relay, NULL, 0);
+    printf("nettest: %s\n", ok ? "passed" : "failed");
+    return ok;
+#else
+    (void)inputDelay;
+    (void)frames;
+    fprintf(stderr, "The netplay test is only supported on UNIX systems.\n");
+    return 0;
+#endif
+}
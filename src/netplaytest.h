@@ -0,0 +1,38 @@
+/* netplaytest.h: Netplay loopback test
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+
+// Runs a whole netplay session on one machine: a relay with latency, jitter
+// and packet loss, and two headless players pressing different buttons so
+// they have to roll back. Passes if both players get to the given frame
+// without desyncing.
+
+// the relay listens on this port and the next one
+#define NETPLAYTEST_PORT (7150)
+#define NETPLAYTEST_DEFAULT_FRAMES (600)
+
+/**
+ * @brief Runs the netplay test. Only supported on UNIX systems.
+ * @param inputDelay input delay for both players
+ * @param frames how many frames both players have to get through
+ * @returns nonzero if the test passed
+ */
+int NetplayTest_Run(int inputDelay, Uint32 frames);
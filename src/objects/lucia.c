@@ -27,6 +27,7 @@
 #include "rng.h"
 #include "sound.h"
 #include "sprite.h"
+#include "state.h"
 #include "weapon.h"
 
 #define WING_MP (1000)
@@ -50,6 +51,25 @@ Sint16 luciaSpriteX;
 Sint16 luciaSpriteY;
 Uint16 luciaMetatile;
 
+void Lucia_RegisterState(void) {
+    State_Register(&bootsLevel, sizeof(bootsLevel), 0);
+    State_Register(&attackTimer, sizeof(attackTimer), 0);
+    State_Register(&hasWing, sizeof(hasWing), 0);
+    State_Register(&usingWing, sizeof(usingWing), 0);
+    State_Register(&luciaDoorFlag, sizeof(luciaDoorFlag), 0);
+    State_Register(&luciaHurtPoints, sizeof(luciaHurtPoints), 0);
+    State_Register(&health, sizeof(health), 0);
+    State_Register(&maxHealth, sizeof(maxHealth), 0);
+    State_Register(&magic, sizeof(magic), 0);
+    State_Register(&maxMagic, sizeof(maxMagic), 0);
+    State_Register(&lives, sizeof(lives), 0);
+    State_Register(&luciaXPos, sizeof(luciaXPos), 0);
+    State_Register(&luciaYPos, sizeof(luciaYPos), 0);
+    State_Register(&luciaSpriteX, sizeof(luciaSpriteX), 0);
+    State_Register(&luciaSpriteY, sizeof(luciaSpriteY), 0);
+    State_Register(&luciaMetatile, sizeof(luciaMetatile), 0);
+}
+
 
 static Sint8 xSpeeds[] = {
     0x00,0x00,0x18,0x18,0x18,0x00,0xE8,0xE8,0xE8,
@@ -46,4 +46,6 @@ void Lucia_WarpDoorObj(Object *o);
 void Lucia_DyingObj(Object *o);
 void Lucia_ClimbObj(Object *o);
 void Lucia_AirObj(Object *o);
+// adds Lucia's variables to the game state
+void Lucia_RegisterState(void);
 
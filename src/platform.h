@@ -111,13 +111,83 @@ int Platform_GetNTSC(void);
 void Platform_SetPaletteType(Uint8 type);
 
 /**
- * @brief Queues the given audio samples to play
- * @param samples The buffer of samples to queue
- * @param count The number of samples in the buffer
+ * @brief Sets the function the audio device gets samples from. It's run on the
+ * audio thread.
+ * @param callback takes a buffer and the number of samples wanted, returns the
+ * number of samples written to the buffer
  */
-void Platform_QueueSamples(Sint16 *samples, int count);
+void Platform_SetAudioCallback(int (*callback)(Sint16 *samples, int count));
 
 /**
- * @returns the number of queued audio samples
+ * @returns the audio device's sample rate in Hz
  */
-int Platform_GetQueuedSamples(void);
\ No newline at end of file
+int Platform_GetSampleRate(void);
+
+/**
+ * @returns the number of times the audio device needed samples and the
+ * audio callback couldn't provide enough
+ */
+Uint32 Platform_GetAudioUnderruns(void);
+
+typedef struct PlatformThread PlatformThread;
+
+/**
+ * @brief Runs a function on a new thread. Doesn't need Platform_Init to have
+ * been run first.
+ * @param func the function to run
+ * @param data gets passed to func
+ * @param name thread name for debuggers
+ * @returns the thread, or NULL if it couldn't be started
+ */
+PlatformThread *Platform_StartThread(int (*func)(void *data), void *data, const char *name);
+
+/**
+ * @brief Waits for a thread to finish
+ * @param thread the thread to wait for
+ * @returns the value the thread's function returned
+ */
+int Platform_WaitThread(PlatformThread *thread);
+
+typedef struct PlatformMutex PlatformMutex;
+
+/**
+ * @brief Creates a mutex. Doesn't need Platform_Init to have been run first.
+ * @returns the mutex, or NULL if it couldn't be created
+ */
+PlatformMutex *Platform_CreateMutex(void);
+
+/**
+ * @brief Locks a mutex, waiting for other threads to unlock it if necessary
+ * @param mutex the mutex to lock
+ */
+void Platform_LockMutex(PlatformMutex *mutex);
+
+/**
+ * @brief Unlocks a mutex
+ * @param mutex the mutex to unlock
+ */
+void Platform_UnlockMutex(PlatformMutex *mutex);
+
+typedef struct PlatformCond PlatformCond;
+
+/**
+ * @brief Creates a condition variable. Doesn't need Platform_Init to have been
+ * run first.
+ * @returns the condition variable, or NULL if it couldn't be created
+ */
+PlatformCond *Platform_CreateCond(void);
+
+/**
+ * @brief Unlocks the mutex and waits for the condition variable to be
+ * signaled, then locks the mutex again
+ * @param cond the condition variable
+ * @param mutex the mutex, must be locked
+ * @param timeoutMs how long to wait at most in milliseconds, or -1 to wait forever
+ */
+void Platform_WaitCond(PlatformCond *cond, PlatformMutex *mutex, int timeoutMs);
+
+/**
+ * @brief Wakes up every thread waiting on the condition variable
+ * @param cond the condition variable
+ */
+void Platform_BroadcastCond(PlatformCond *cond);
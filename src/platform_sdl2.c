@@ -20,7 +20,9 @@
 #include <SDL.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "alloc.h"
 #include "constants.h"
 #include "db.h"
 #include "file.h"
@@ -30,6 +32,7 @@
 #include "nanotime.h"
 #include "nes_ntsc.h"
 #include "platform.h"
+#include "writer.h"
 
 // --- video stuff ---
 static Uint8 frameStarted = 0;
@@ -52,6 +55,19 @@ static Uint8 ntscEnabled = 0;
 
 // --- audio stuff ---
 static SDL_AudioDeviceID audioDevice;
+// samples per audio callback, keeps the device's own buffering small
+#define AUDIO_PERIOD (256)
+// used if the device doesn't say what rate it wants, or there's no device
+#define DEFAULT_AUDIO_RATE (44100)
+// the device's own sample rate, so SDL doesn't have to resample
+static int audioRate = DEFAULT_AUDIO_RATE;
+// where the audio thread gets samples from
+static int (*audioCallback)(Sint16 *samples, int count) = NULL;
+// times the audio callback couldn't provide enough samples
+static SDL_atomic_t audioUnderruns;
+// don't count underruns from before the sound engine starts, only touched by
+// the audio thread
+static int audioStarted = 0;
 
 // --- palette stuff ---
 #define NUM_COLORS 64
@@ -352,16 +368,41 @@ void Platform_SetPaletteType(Uint8 type) {
     }
 }
 
+// fills out the buffer from the audio callback, padding it with silence
+static void Platform_GetSamples(Sint16 *out, int count) {
+    int written = audioCallback ? audioCallback(out, count) : 0;
+    if (written) { audioStarted = 1; }
+    if (written < count) {
+        memset(out + written, 0, (count - written) * sizeof(Sint16));
+        if (audioStarted) { SDL_AtomicIncRef(&audioUnderruns); }
+    }
+}
+
+static void SDLCALL Platform_AudioCallback(void *userdata, Uint8 *stream, int len) {
+    (void)userdata;
+    Platform_GetSamples((Sint16 *)stream, len / (int)sizeof(Sint16));
+}
+
 static int Platform_InitAudio(void) {
     SDL_AudioSpec spec = { 0 };
-    spec.freq = 44100;
+#if SDL_VERSION_ATLEAST(2, 24, 0)
+    SDL_AudioSpec deviceSpec;
+    if (SDL_GetDefaultAudioInfo(NULL, &deviceSpec, 0) == 0) {
+        audioRate = deviceSpec.freq;
+    }
+#endif
+    spec.freq = audioRate;
     spec.format = AUDIO_S16;
     spec.channels = 1;
-    audioDevice = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
+    spec.samples = AUDIO_PERIOD;
+    spec.callback = Platform_AudioCallback;
+    SDL_AudioSpec obtained;
+    audioDevice = SDL_OpenAudioDevice(NULL, 0, &spec, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
     if (!audioDevice) {
         Platform_ShowError("Error creating audioDevice: %s", SDL_GetError());
         return 0;
     }
+    audioRate = obtained.freq;
     SDL_PauseAudioDevice(audioDevice, 0);
     return 1;
 }
@@ -370,12 +411,62 @@ static void Platform_DestroyAudio(void) {
     SDL_CloseAudioDevice(audioDevice);
 }
 
-void Platform_QueueSamples(Sint16 *samples, int count) {
-    SDL_QueueAudio(audioDevice, (void *)samples, count * sizeof(Sint16));
+void Platform_SetAudioCallback(int (*callback)(Sint16 *samples, int count)) {
+    // headless runs don't have an audio device
+    if (!audioDevice) {
+        audioCallback = callback;
+        return;
+    }
+    SDL_LockAudioDevice(audioDevice);
+    audioCallback = callback;
+    SDL_UnlockAudioDevice(audioDevice);
+}
+
+PlatformThread *Platform_StartThread(int (*func)(void *data), void *data, const char *name) {
+    return (PlatformThread *)SDL_CreateThread(func, name, data);
+}
+
+int Platform_WaitThread(PlatformThread *thread) {
+    int status = 0;
+    SDL_WaitThread((SDL_Thread *)thread, &status);
+    return status;
+}
+
+PlatformMutex *Platform_CreateMutex(void) {
+    return (PlatformMutex *)SDL_CreateMutex();
+}
+
+void Platform_LockMutex(PlatformMutex *mutex) {
+    SDL_LockMutex((SDL_mutex *)mutex);
+}
+
+void Platform_UnlockMutex(PlatformMutex *mutex) {
+    SDL_UnlockMutex((SDL_mutex *)mutex);
+}
+
+PlatformCond *Platform_CreateCond(void) {
+    return (PlatformCond *)SDL_CreateCond();
 }
 
-int Platform_GetQueuedSamples(void) {
-    return (int)SDL_GetQueuedAudioSize(audioDevice) / sizeof(Sint16);
+void Platform_WaitCond(PlatformCond *cond, PlatformMutex *mutex, int timeoutMs) {
+    if (timeoutMs < 0) {
+        SDL_CondWait((SDL_cond *)cond, (SDL_mutex *)mutex);
+    }
+    else {
+        SDL_CondWaitTimeout((SDL_cond *)cond, (SDL_mutex *)mutex, (Uint32)timeoutMs);
+    }
+}
+
+void Platform_BroadcastCond(PlatformCond *cond) {
+    SDL_CondBroadcast((SDL_cond *)cond);
+}
+
+int Platform_GetSampleRate(void) {
+    return audioRate;
+}
+
+Uint32 Platform_GetAudioUnderruns(void) {
+    return (Uint32)SDL_AtomicGet(&audioUnderruns);
 }
 
 static int Platform_LoadPalette(char *filename, Uint32 *out, Uint8 *outNtsc) {
@@ -439,6 +530,14 @@ int Platform_Init(void) {
 }
 
 void Platform_Quit(void) {
+    // make sure everything the game saved actually gets written
+    Writer_Flush();
+    if (Platform_GetAudioUnderruns()) {
+        printf("audio: %u underruns\n", Platform_GetAudioUnderruns());
+    }
+#ifdef OM_ALLOC_CHECK
+    Alloc_PrintStats();
+#endif
     Platform_DestroyVideo();
     Platform_DestroyAudio();
     SDL_Quit();
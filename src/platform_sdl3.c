@@ -21,7 +21,9 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "alloc.h"
 #include "constants.h"
 #include "db.h"
 #include "file.h"
@@ -32,6 +34,7 @@
 #include "nes_ntsc.h"
 #include "palette.h"
 #include "platform.h"
+#include "writer.h"
 
 // --- video stuff ---
 static Uint8 frameStarted = 0;
@@ -55,6 +58,19 @@ static Uint8 ntscEnabled = 0;
 
 // --- audio stuff ---
 static SDL_AudioStream *audioStream;
+// samples per audio callback, keeps the device's own buffering small
+#define AUDIO_PERIOD (256)
+// used if the device doesn't say what rate it wants, or there's no device
+#define DEFAULT_AUDIO_RATE (44100)
+// the device's own sample rate, so SDL doesn't have to resample
+static int audioRate = DEFAULT_AUDIO_RATE;
+// where the audio thread gets samples from
+static int (*audioCallback)(Sint16 *samples, int count) = NULL;
+// times the audio callback couldn't provide enough samples
+static SDL_AtomicInt audioUnderruns;
+// don't count underruns from before the sound engine starts, only touched by
+// the audio thread
+static int audioStarted = 0;
 
 // --- palette stuff ---
 #define NUM_COLORS 64
@@ -358,12 +374,42 @@ void Platform_SetPaletteType(Uint8 type) {
     }
 }
 
+// fills out the buffer from the audio callback, padding it with silence
+static void Platform_GetSamples(Sint16 *out, int count) {
+    int written = audioCallback ? audioCallback(out, count) : 0;
+    if (written) { audioStarted = 1; }
+    if (written < count) {
+        memset(out + written, 0, (count - written) * sizeof(Sint16));
+        if (audioStarted) { SDL_AddAtomicInt(&audioUnderruns, 1); }
+    }
+}
+
+static void SDLCALL Platform_AudioCallback(void *userdata, SDL_AudioStream *stream, int additional, int total) {
+    (void)userdata;
+    (void)total;
+    Sint16 samples[AUDIO_PERIOD];
+    int count = additional / (int)sizeof(Sint16);
+    while (count > 0) {
+        int chunk = MIN(count, AUDIO_PERIOD);
+        Platform_GetSamples(samples, chunk);
+        SDL_PutAudioStreamData(stream, samples, chunk * sizeof(Sint16));
+        count -= chunk;
+    }
+}
+
 static int Platform_InitAudio(void) {
     SDL_AudioSpec spec = { 0 };
-    spec.freq = 44100;
+    SDL_AudioSpec deviceSpec;
+    if (SDL_GetAudioDeviceFormat(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &deviceSpec, NULL)) {
+        audioRate = deviceSpec.freq;
+    }
+    spec.freq = audioRate;
     spec.format = SDL_AUDIO_S16;
     spec.channels = 1;
-    audioStream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, NULL, NULL);
+    char period[16];
+    snprintf(period, sizeof(period), "%d", AUDIO_PERIOD);
+    SDL_SetHint(SDL_HINT_AUDIO_DEVICE_SAMPLE_FRAMES, period);
+    audioStream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, Platform_AudioCallback, NULL);
     if (!audioStream) {
         Platform_ShowError("Error creating audioStream: %s", SDL_GetError());
         return 0;
@@ -376,12 +422,62 @@ static void Platform_DestroyAudio(void) {
     SDL_DestroyAudioStream(audioStream);
 }
 
-void Platform_QueueSamples(Sint16 *samples, int count) {
-    SDL_PutAudioStreamData(audioStream, (void *)samples, count * sizeof(Sint16));
+void Platform_SetAudioCallback(int (*callback)(Sint16 *samples, int count)) {
+    // headless runs don't have an audio device
+    if (!audioStream) {
+        audioCallback = callback;
+        return;
+    }
+    SDL_LockAudioStream(audioStream);
+    audioCallback = callback;
+    SDL_UnlockAudioStream(audioStream);
+}
+
+PlatformThread *Platform_StartThread(int (*func)(void *data), void *data, const char *name) {
+    return (PlatformThread *)SDL_CreateThread(func, name, data);
+}
+
+int Platform_WaitThread(PlatformThread *thread) {
+    int status = 0;
+    SDL_WaitThread((SDL_Thread *)thread, &status);
+    return status;
+}
+
+PlatformMutex *Platform_CreateMutex(void) {
+    return (PlatformMutex *)SDL_CreateMutex();
 }
 
-int Platform_GetQueuedSamples(void) {
-    return (int)SDL_GetAudioStreamQueued(audioStream) / sizeof(Sint16);
+void Platform_LockMutex(PlatformMutex *mutex) {
+    SDL_LockMutex((SDL_Mutex *)mutex);
+}
+
+void Platform_UnlockMutex(PlatformMutex *mutex) {
+    SDL_UnlockMutex((SDL_Mutex *)mutex);
+}
+
+PlatformCond *Platform_CreateCond(void) {
+    return (PlatformCond *)SDL_CreateCondition();
+}
+
+void Platform_WaitCond(PlatformCond *cond, PlatformMutex *mutex, int timeoutMs) {
+    if (timeoutMs < 0) {
+        SDL_WaitCondition((SDL_Condition *)cond, (SDL_Mutex *)mutex);
+    }
+    else {
+        SDL_WaitConditionTimeout((SDL_Condition *)cond, (SDL_Mutex *)mutex, (Sint32)timeoutMs);
+    }
+}
+
+void Platform_BroadcastCond(PlatformCond *cond) {
+    SDL_BroadcastCondition((SDL_Condition *)cond);
+}
+
+int Platform_GetSampleRate(void) {
+    return audioRate;
+}
+
+Uint32 Platform_GetAudioUnderruns(void) {
+    return (Uint32)SDL_GetAtomicInt(&audioUnderruns);
 }
 
 static int Platform_LoadPalette(char *filename, Uint32 *out, Uint8 *outNtsc) {
@@ -446,6 +542,14 @@ int Platform_Init(void) {
 }
 
 void Platform_Quit(void) {
+    // make sure everything the game saved actually gets written
+    Writer_Flush();
+    if (Platform_GetAudioUnderruns()) {
+        printf("audio: %u underruns\n", Platform_GetAudioUnderruns());
+    }
+#ifdef OM_ALLOC_CHECK
+    Alloc_PrintStats();
+#endif
     Platform_DestroyVideo();
     Platform_DestroyAudio();
     SDL_Quit();
@@ -0,0 +1,138 @@
+/* relay.c: UDP relay that simulates a bad network connection
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "constants.h"
+#include "nanotime.h"
+#include "net.h"
+#include "relay.h"
+
+#define MAX_PACKETS (1024)
+#define MAX_PACKET_SIZE (512)
+#define NSEC_PER_MSEC (1000000)
+// how often to print stats
+#define STATS_INTERVAL (5 * NANOTIME_NSEC_PER_SEC)
+
+typedef struct {
+    int inUse;
+    // which side it goes out of (0 = A, 1 = B)
+    int side;
+    uint64_t sendTime;
+    int len;
+    Uint8 data[MAX_PACKET_SIZE];
+} RelayPacket;
+
+static RelayPacket packets[MAX_PACKETS];
+
+typedef struct {
+    NetSocket *sock;
+    NetAddr peer;
+    int havePeer;
+    Uint32 received;
+    Uint32 dropped;
+} RelaySide;
+
+static RelaySide sides[2];
+
+static void Relay_Queue(RelayConfig *config, int side, Uint8 *data, int len, uint64_t now) {
+    if ((rand() % 100) < config->loss) {
+        sides[side].dropped++;
+        return;
+    }
+    int delay = config->latency;
+    if (config->jitter) {
+        delay += (rand() % ((config->jitter * 2) + 1)) - config->jitter;
+    }
+    if (delay < 0) { delay = 0; }
+
+    for (int i = 0; i < MAX_PACKETS; i++) {
+        if (!packets[i].inUse) {
+            packets[i].inUse = 1;
+            packets[i].side = side;
+            packets[i].sendTime = now + ((uint64_t)delay * NSEC_PER_MSEC);
+            packets[i].len = len;
+            memcpy(packets[i].data, data, len);
+            return;
+        }
+    }
+    // queue's full, which is the same as a lost packet
+    sides[side].dropped++;
+}
+
+int Relay_Run(RelayConfig *config) {
+    Uint16 ports[2] = {config->portA, config->portB};
+    for (int i = 0; i < 2; i++) {
+        memset(&sides[i], 0, sizeof(RelaySide));
+        sides[i].sock = Net_Open(ports[i]);
+        if (!sides[i].sock) {
+            fprintf(stderr, "Couldn't open UDP port %d.\n", ports[i]);
+            return 0;
+        }
+    }
+    srand((unsigned int)time(NULL));
+    printf("relay: ports %d <-> %d, latency %d ms, jitter %d ms, loss %d%%\n",
+           config->portA, config->portB, config->latency, config->jitter, config->loss);
+
+    uint64_t lastStats = nanotime_now();
+    while (1) {
+        uint64_t now = nanotime_now();
+
+        // anything that comes in one side goes out the other
+        for (int i = 0; i < 2; i++) {
+            Uint8 data[MAX_PACKET_SIZE];
+            NetAddr from;
+            int len;
+            while ((len = Net_Recv(sides[i].sock, &from, data, sizeof(data)))) {
+                if (!sides[i].havePeer) {
+                    sides[i].peer = from;
+                    sides[i].havePeer = 1;
+                    printf("relay: side %c connected\n", 'A' + i);
+                }
+                else if (!Net_AddrEqual(&from, &sides[i].peer)) {
+                    continue;
+                }
+                sides[i].received++;
+                Relay_Queue(config, !i, data, len, now);
+            }
+        }
+
+        for (int i = 0; i < MAX_PACKETS; i++) {
+            RelayPacket *packet = &packets[i];
+            if (packet->inUse && (packet->sendTime <= now)) {
+                RelaySide *side = &sides[packet->side];
+                // hold onto it until the other player shows up
+                if (!side->havePeer) { continue; }
+                Net_Send(side->sock, &side->peer, packet->data, packet->len);
+                packet->inUse = 0;
+            }
+        }
+
+        if ((now - lastStats) >= STATS_INTERVAL) {
+            printf("relay: A sent %u (%u dropped), B sent %u (%u dropped)\n",
+                   sides[0].received, sides[0].dropped, sides[1].received, sides[1].dropped);
+            lastStats = now;
+        }
+        nanotime_sleep(NSEC_PER_MSEC / 2);
+    }
+    return 1;
+}
@@ -0,0 +1,44 @@
+/* relay.h: UDP relay that simulates a bad network connection
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "constants.h"
+
+// For testing netplay on one machine. Each player points their netplay
+// session at one of the relay's ports, and whatever gets sent to one port
+// comes out of the other one after the configured delay. The players'
+// addresses are picked up from the first packet each port receives.
+
+typedef struct {
+    Uint16 portA;
+    Uint16 portB;
+    // base one-way latency in milliseconds
+    int latency;
+    // each packet's latency is randomly adjusted by up to this many milliseconds
+    int jitter;
+    // percent chance of dropping each packet
+    int loss;
+} RelayConfig;
+
+/**
+ * @brief Runs the relay until the program is killed.
+ * @param config relay settings
+ * @returns zero if the relay couldn't be started
+ */
+int Relay_Run(RelayConfig *config);
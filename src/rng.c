@@ -16,16 +16,59 @@
  * You should have received a copy of the GNU General Public License
  * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
  */
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "alloc.h"
+#include "buffer.h"
 #include "constants.h"
+#include "db.h"
+#include "game.h"
+#include "rng.h"
+#include "util.h"
+#include "writer.h"
 
 Uint8 rngVal;
+static int seedFixed = 0;
+static Uint16 fixedSeed;
+// every seed picked during this run, written out to RNG_LOG_FILENAME
+static Buffer *seedLog = NULL;
 
-void RNG_Seed(void) {
-    srand((unsigned int)time(NULL));
-    rngVal = (Uint8)rand();
+void RNG_SetSeed(Uint16 seed) {
+    seedFixed = 1;
+    fixedSeed = seed;
+}
+
+void RNG_LoadSettings(void) {
+    // the command line takes priority over the config file
+    if (seedFixed) { return; }
+    DBEntry *entry = DB_Find("seed");
+    if (entry && (entry->dataLen >= 2)) {
+        RNG_SetSeed(Util_LoadUint16(entry->data));
+    }
+}
+
+void RNG_Seed(const char *reason) {
+    if (seedFixed) {
+        rngVal = (Uint8)fixedSeed;
+        gameFrames = (Uint8)(fixedSeed >> 8);
+    }
+    else {
+        srand((unsigned int)time(NULL));
+        rngVal = (Uint8)rand();
+    }
+    // passing this to -seed reproduces the run from here
+    char line[128];
+    int len = snprintf(line, sizeof(line), "rng: seed %u (%s%s)\n", (unsigned)(rngVal | (gameFrames << 8)),
+                       reason, seedFixed ? ", fixed" : "");
+    len = MIN(len, (int)sizeof(line) - 1);
+    printf("%s", line);
+    Alloc_AllowBegin();
+    if (!seedLog) { seedLog = Buffer_Init(256); }
+    Buffer_AddData(seedLog, (Uint8 *)line, len);
+    Alloc_AllowEnd();
+    Writer_Write(RNG_LOG_FILENAME, seedLog->data, seedLog->dataSize);
 }
 
 Uint8 RNG_Get(void) {
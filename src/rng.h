@@ -22,12 +22,30 @@
 
 extern Uint8 rngVal;
 
+// every seed RNG_Seed picked during the last run gets written here
+#define RNG_LOG_FILENAME "seeds.log"
+
+/**
+ * @brief Makes RNG_Seed always use the given seed instead of the current time,
+ * so runs can be reproduced.
+ * @param seed low byte = rngVal, high byte = gameFrames
+ */
+void RNG_SetSeed(Uint16 seed);
+
+/**
+ * @brief Loads the fixed seed from the config file, if there is one and one
+ * wasn't already set with RNG_SetSeed. Should be run after DB_Init.
+ */
+void RNG_LoadSettings(void);
+
 /**
  * @brief Seeds the RNG from current time. Necessary because the demos overwrite
  * the RNG seed and I don't want that to make every new game start with the same
- * enemy pattern.
+ * enemy pattern. If a fixed seed was set, rngVal and gameFrames get set from it
+ * instead. The seed gets printed and added to RNG_LOG_FILENAME either way.
+ * @param reason what the seed is for, gets printed with it
  */
-void RNG_Seed(void);
+void RNG_Seed(const char *reason);
 
 /**
 * @brief Updates the RNG value
@@ -23,14 +23,18 @@
 
 #include "alloc.h"
 #include "constants.h"
+#include "db.h"
 #include "file.h"
 #include "map.h"
 #include "platform.h"
 #include "rom.h"
+#include "util.h"
 
 Uint8 prgRom[PRG_ROM_SIZE];
 Uint8 *chrRom = NULL;
 int chrRomSize = 0;
+// sized so the font can be added to the end of CHR ROM without a new block
+static Arena romArena = ARENA_INIT(ALLOC_TAG_ROM, 0x8000 + FONT_SIZE);
 
 Uint16 tilesetBases[3] = {
     1024, // Forest
@@ -38,41 +42,110 @@ Uint16 tilesetBases[3] = {
     1536, // Castle
 };
 
+// the ROM comes right after this string (and its NUL terminator) in the Steam data
+static const char steamSearchStr[] = "MadoolaRAGdump";
+#define STEAM_SEARCH_LEN (sizeof(steamSearchStr))
+// distance from the start of the search string to the ROM data
+#define STEAM_ROM_OFFSET (36)
+// config.db entry with where the ROM was found last time, so we don't have to
+// search the asset file on every launch
+// Uint32: asset file size
+// Uint32: asset file modification time (high 32 bits)
+// Uint32: asset file modification time (low 32 bits)
+// Uint32: offset of the search string in the asset file
+#define STEAM_DB_ENTRY "steamrom"
+#define STEAM_DB_SIZE (16)
+
+// Horspool search, skips ahead by up to the length of the search string at a time
+static Uint8 *Rom_Search(Uint8 *data, Uint32 size, const Uint8 *str, Uint32 len) {
+    if (size < len) { return NULL; }
+    Uint32 skip[256];
+    for (int i = 0; i < 256; i++) {
+        skip[i] = len;
+    }
+    for (Uint32 i = 0; i < len - 1; i++) {
+        skip[str[i]] = len - 1 - i;
+    }
+    Uint32 pos = 0;
+    while (pos <= size - len) {
+        Uint8 last = data[pos + len - 1];
+        if ((last == str[len - 1]) && (memcmp(data + pos, str, len - 1) == 0)) {
+            return data + pos;
+        }
+        pos += skip[last];
+    }
+    return NULL;
+}
+
+static int Rom_ReadFromSteam(FILE *fp, Uint32 offset) {
+    // make sure the ROM is actually there
+    char header[STEAM_SEARCH_LEN];
+    if (!File_ReadAt(fp, offset, header, STEAM_SEARCH_LEN)) { return 0; }
+    if (memcmp(header, steamSearchStr, STEAM_SEARCH_LEN) != 0) { return 0; }
+
+    offset += STEAM_ROM_OFFSET;
+    if (!File_ReadAt(fp, offset, prgRom, PRG_ROM_SIZE)) { return 0; }
+    Uint8 *chr = Arena_Alloc(&romArena, 0x8000);
+    if (!File_ReadAt(fp, offset + PRG_ROM_SIZE, chr, 0x8000)) {
+        Arena_Reset(&romArena);
+        return 0;
+    }
+    chrRomSize = 0x8000;
+    chrRom = chr;
+    return 1;
+}
+
 static int Rom_LoadFromSteam(FILE *fp) {
-    int size;
-    Uint8 *steamData = File_Load(fp, &size);
-    fclose(fp);
+    Uint32 size = 0;
+    uint64_t mtime = 0;
+    int haveInfo = File_GetInfo(fp, &size, &mtime);
+
+    // if the asset file hasn't changed since the last launch, we already know where the ROM is
+    DBEntry *entry = DB_Find(STEAM_DB_ENTRY);
+    if (haveInfo && entry && (entry->dataLen == STEAM_DB_SIZE) &&
+        (Util_LoadUint32(entry->data) == size) &&
+        (Util_LoadUint32(entry->data + 4) == (Uint32)(mtime >> 32)) &&
+        (Util_LoadUint32(entry->data + 8) == (Uint32)mtime) &&
+        Rom_ReadFromSteam(fp, Util_LoadUint32(entry->data + 12))) {
+        fclose(fp);
+        return 1;
+    }
 
-    // look for ROM in data file
-    char searchStr[] = "MadoolaRAGdump";
-    int searchStrLen = sizeof(searchStr);
-    Uint8 *ptr = steamData;
-    int found = 0;
-    while (ptr) {
-        int sizeLeft = size - (int)(ptr - steamData);
-        ptr = memchr(ptr, searchStr[0], sizeLeft);
-        if (ptr && (sizeLeft >= searchStrLen) && (memcmp(ptr, searchStr, searchStrLen) == 0)) {
-            found = 1;
-            break;
-        }
-        else if (ptr) {
-            ptr++;
-        }
+    // look for ROM in data file. The file's big, so map it instead of reading
+    // the whole thing in if we can.
+    Uint32 mappedSize = 0;
+    Uint8 *steamData = File_Map(fp, &mappedSize);
+    Uint32 dataSize = mappedSize;
+    if (!steamData) {
+        int loadedSize;
+        steamData = File_Load(fp, &loadedSize);
+        dataSize = (Uint32)loadedSize;
     }
-    if (!found) {
-        Platform_ShowError("Couldn't find ROM file in Steam data");
+    Uint8 *found = Rom_Search(steamData, dataSize, (const Uint8 *)steamSearchStr, STEAM_SEARCH_LEN);
+    Uint32 offset = found ? (Uint32)(found - steamData) : 0;
+    if (mappedSize) {
+        File_Unmap(steamData, mappedSize);
+    }
+    else {
         free(steamData);
+    }
+
+    if (!found || !Rom_ReadFromSteam(fp, offset)) {
+        fclose(fp);
+        Platform_ShowError("Couldn't find ROM file in Steam data");
         return 0;
     }
+    fclose(fp);
 
-    // read in data
-    ptr += 36;
-    memcpy(prgRom, ptr, PRG_ROM_SIZE);
-    ptr += PRG_ROM_SIZE;
-    chrRomSize = 0x8000;
-    chrRom = ommalloc(chrRomSize);
-    memcpy(chrRom, ptr, chrRomSize);
-    free(steamData);
+    if (haveInfo) {
+        Uint8 dbData[STEAM_DB_SIZE];
+        Util_SaveUint32(size, dbData);
+        Util_SaveUint32((Uint32)(mtime >> 32), dbData + 4);
+        Util_SaveUint32((Uint32)mtime, dbData + 8);
+        Util_SaveUint32(offset, dbData + 12);
+        DB_Set(STEAM_DB_ENTRY, dbData, STEAM_DB_SIZE);
+        DB_Save();
+    }
     return 1;
 }
 
@@ -86,39 +159,71 @@ static int Rom_LoadFromNesFile(FILE *fp) {
     }
     memcpy(prgRom, romData + 0x10, PRG_ROM_SIZE);
     chrRomSize = 0x8000;
-    chrRom = ommalloc(chrRomSize);
+    chrRom = Arena_Alloc(&romArena, chrRomSize);
     memcpy(chrRom, romData + 0x10 + PRG_ROM_SIZE, chrRomSize);
     free(romData);
     return 1;
 }
 
-int Rom_Load(void) {
-    FILE *fp;
+// places the ROM can be loaded from, in the order they're tried
+enum {
+    // the rom file
+    ROM_SOURCE_NES,
+    // the asset file from the Sunsoft collection
+    ROM_SOURCE_STEAM,
+#ifdef OM_WINDOWS
+    // the default install location for the Sunsoft collection
+    ROM_SOURCE_STEAM_DEFAULT,
+#endif
+    ROM_NUM_SOURCES,
+};
 
-    // try to load data from the rom file
-    fp = File_OpenResource("madoola.nes", "rb");
-    if (fp && Rom_LoadFromNesFile(fp)) {
-        return 1;
-    }
+static FILE *Rom_OpenSource(int source) {
+    switch (source) {
+    case ROM_SOURCE_NES:
+        return File_OpenResource("madoola.nes", "rb");
 
-    // if there's no rom file, look for the asset file from the Sunsoft collection
-    fp = File_OpenResource("sharedassets0.assets", "rb");
-    if (fp && Rom_LoadFromSteam(fp)) {
-        return 1;
-    }
+    case ROM_SOURCE_STEAM:
+        return File_OpenResource("sharedassets0.assets", "rb");
 
-    // if there's no asset file, try loading from the default install location for the Sunsoft collection
 #ifdef OM_WINDOWS
-    fp = _wfopen(L"C:\\Program Files (x86)\\Steam\\steamapps\\common\\SUNSOFT is Back! レトロゲームセレクション\\SUNSOFT is Back! Retro Game Selection_Data\\sharedassets0.assets", L"rb");
-    if (fp && Rom_LoadFromSteam(fp)) {
-        return 1;
-    }
+    case ROM_SOURCE_STEAM_DEFAULT:
+        return _wfopen(L"C:\\Program Files (x86)\\Steam\\steamapps\\common\\SUNSOFT is Back! レトロゲームセレクション\\SUNSOFT is Back! Retro Game Selection_Data\\sharedassets0.assets", L"rb");
 #endif
+    }
+    return NULL;
+}
+
+int Rom_Load(void) {
+    for (int i = 0; i < ROM_NUM_SOURCES; i++) {
+        FILE *fp = Rom_OpenSource(i);
+        if (!fp) { continue; }
+        if (i == ROM_SOURCE_NES) {
+            if (Rom_LoadFromNesFile(fp)) { return 1; }
+        }
+        else if (Rom_LoadFromSteam(fp)) {
+            return 1;
+        }
+    }
 
     Platform_ShowError("Couldn't find madoola.nes or sharedassets0.assets. Check the readme file for more information.");
     return 0;
 }
 
+int Rom_NumSources(void) {
+    return ROM_NUM_SOURCES;
+}
+
+void Rom_GetSourceInfo(int source, Uint32 *size, uint64_t *mtime) {
+    *size = 0;
+    *mtime = 0;
+    FILE *fp = Rom_OpenSource(source);
+    if (fp) {
+        File_GetInfo(fp, size, mtime);
+        fclose(fp);
+    }
+}
+
 int Rom_LoadChr(char *filename, int size) {
     FILE *fp = File_OpenResource(filename, "rb");
     if (!fp) {
@@ -126,7 +231,7 @@ int Rom_LoadChr(char *filename, int size) {
         return 0;
     }
 
-    chrRom = omrealloc(chrRom, chrRomSize + size);
+    chrRom = Arena_Realloc(&romArena, chrRom, chrRomSize, chrRomSize + size);
     fread(chrRom + chrRomSize, 1, size, fp);
     fclose(fp);
 
@@ -136,7 +241,7 @@ int Rom_LoadChr(char *filename, int size) {
 
 static int init_tileset(MapData *data, int num, int length, Uint16 base, int pal_offset, int rom_offset) {
     data->tilesets[num].len = length;
-    data->tilesets[num].metatiles = ommalloc(length * sizeof(Metatile));
+    data->tilesets[num].metatiles = Arena_Alloc(&mapArena, length * sizeof(Metatile));
     for (int i = 0; i < length; i++) {
         data->tilesets[num].metatiles[i].palnum   = (Uint16)prgRom[pal_offset++];
         data->tilesets[num].metatiles[i].tiles[0] = (Uint16)prgRom[rom_offset++] + base;
@@ -148,14 +253,14 @@ static int init_tileset(MapData *data, int num, int length, Uint16 base, int pal
     return rom_offset;
 }
 
-MapData *Rom_GetMapData(void) {
-    MapData *data = ommalloc(sizeof(MapData));
+static MapData *Rom_ParseMapData(void) {
+    MapData *data = Arena_Alloc(&mapArena, sizeof(MapData));
     // position in the PRG ROM
     int cursor = 0;
 
     // there are 3 tilesets (forest, cave, castle)
     data->numTilesets = 3;
-    data->tilesets = ommalloc(data->numTilesets * sizeof(Tileset));
+    data->tilesets = Arena_Alloc(&mapArena, data->numTilesets * sizeof(Tileset));
 
     // forest tileset has 164 metatiles
     #define FOREST_PALS (0x2790)
@@ -171,7 +276,7 @@ MapData *Rom_GetMapData(void) {
 
     // there are 223 chunks
     data->numChunks = 223;
-    data->chunks = ommalloc(data->numChunks * sizeof(data->chunks[0]));
+    data->chunks = Arena_Alloc(&mapArena, data->numChunks * sizeof(data->chunks[0]));
     for (int i = 0; i < data->numChunks; i++) {
         for (int j = 0; j < ARRAY_LEN(data->chunks[0]); j++) {
             data->chunks[i][j] = (Uint16)prgRom[cursor++];
@@ -180,7 +285,7 @@ MapData *Rom_GetMapData(void) {
 
     // there are 159 screens
     data->numScreens = 159;
-    data->screens = ommalloc(data->numScreens * sizeof(data->screens[0]));
+    data->screens = Arena_Alloc(&mapArena, data->numScreens * sizeof(data->screens[0]));
     for (int i = 0; i < data->numScreens; i++) {
         for (int j = 0; j < ARRAY_LEN(data->screens[0]); j++) {
             data->screens[i][j] = (Uint16)prgRom[cursor++];
@@ -265,7 +370,7 @@ MapData *Rom_GetMapData(void) {
     #define WARP_DOOR_ROOM_TBL (0x423a)
     
     data->numWarpDoors = 272;
-    data->warpDoors = ommalloc(data->numWarpDoors * sizeof(WarpDoor));
+    data->warpDoors = Arena_Alloc(&mapArena, data->numWarpDoors * sizeof(WarpDoor));
     for (int i = 0; i < data->numWarpDoors; i++) {
         data->warpDoors[i].xPos = prgRom[WARP_DOOR_X_TBL + i];
         data->warpDoors[i].yPos = prgRom[WARP_DOOR_Y_TBL + i];
@@ -274,6 +379,25 @@ MapData *Rom_GetMapData(void) {
     return data;
 }
 
+// parsed during startup so the first game start doesn't have to do it
+static MapData *prefetchedMapData = NULL;
+
+int Rom_PrefetchMapData(void) {
+    prefetchedMapData = Rom_ParseMapData();
+    return 1;
+}
+
+MapData *Rom_GetMapData(void) {
+    // the caller owns the returned data, so the prefetched copy can only be
+    // handed out once
+    if (prefetchedMapData) {
+        MapData *data = prefetchedMapData;
+        prefetchedMapData = NULL;
+        return data;
+    }
+    return Rom_ParseMapData();
+}
+
 MapData *Rom_GetMapDataArcade(void) {
     MapData *data = Rom_GetMapData();
     // room 0's palette is changed to be the same as room 1's
@@ -22,6 +22,9 @@
 #include "map.h"
 
 #define PRG_ROM_SIZE 0x8000
+// gets loaded after the ROM's CHR data
+#define FONT_FILENAME "font.bin"
+#define FONT_SIZE 4096
 extern Uint8 prgRom[PRG_ROM_SIZE];
 extern Uint8 *chrRom;
 extern int chrRomSize;
@@ -33,6 +36,21 @@ extern Uint16 tilesetBases[3];
 */
 int Rom_Load(void);
 
+/**
+ * @returns how many places Rom_Load looks for the ROM
+ */
+int Rom_NumSources(void);
+
+/**
+ * @brief Gets the size and modification time of one of the files Rom_Load
+ * looks for, so data built from the ROM can be checked for staleness without
+ * loading it.
+ * @param source which file (0 to Rom_NumSources() - 1)
+ * @param size (out) the file's size, 0 if it doesn't exist
+ * @param mtime (out) the file's modification time, 0 if it doesn't exist
+ */
+void Rom_GetSourceInfo(int source, Uint32 *size, uint64_t *mtime);
+
 /**
  * @brief Loads a file to the end of the CHR ROM array. Rom_Load must be called
  * before this function.
@@ -42,6 +60,13 @@ int Rom_Load(void);
 */
 int Rom_LoadChr(char *filename, int size);
 
+/**
+ * @brief Parses the map data ahead of time so the next Rom_GetMapData call can
+ * return it right away. Rom_Load must be called first.
+ * @returns 1 on success, 0 on failure
+ */
+int Rom_PrefetchMapData(void);
+
 /**
  * @brief allocates a MapData struct and fills it with map data from the ROM image
 */
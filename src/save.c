@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "bg.h"
 #include "buffer.h"
 #include "constants.h"
@@ -39,6 +40,7 @@
 #include "task.h"
 #include "util.h"
 #include "weapon.h"
+#include "writer.h"
 
 static Uint8 savePalette[] = {
     0x0f, 0x20, 0x20, 0x20,
@@ -61,16 +63,10 @@ void Save_Serialize(Buffer *buf) {
     Buffer_Add(buf, highestReachedStage);
     Buffer_Add(buf, keywordDisplay);
     Buffer_Add(buf, orbCollected);
-    for (int i = 0; i < NUM_WEAPONS; i++) {
-        Buffer_Add(buf, weaponLevels[i]);
-    }
+    Buffer_AddData(buf, weaponLevels, sizeof(weaponLevels));
     Buffer_Add(buf, bootsLevel);
-    for (int i = 0; i < ARRAY_LEN(itemsCollected); i++) {
-        Buffer_Add(buf, itemsCollected[i]);
-    }
-    for (int i = 0; i < ARRAY_LEN(bossDefeated); i++) {
-        Buffer_Add(buf, bossDefeated[i]);
-    }
+    Buffer_AddData(buf, itemsCollected, sizeof(itemsCollected));
+    Buffer_AddData(buf, bossDefeated, sizeof(bossDefeated));
 }
 
 int Save_Deserialize(Uint8 *data) {
@@ -95,6 +91,7 @@ int Save_Deserialize(Uint8 *data) {
 void Save_SaveFile(void) {
     char filename[20];
 
+    Alloc_AllowBegin();
     if (!files[currFile]) {
         files[currFile] = Buffer_Init(64);
     }
@@ -102,6 +99,7 @@ void Save_SaveFile(void) {
     Save_Serialize(files[currFile]);
     snprintf(filename, sizeof(filename), "file%d.sav", currFile + 1);
     Buffer_WriteToFile(files[currFile], filename);
+    Alloc_AllowEnd();
 }
 
 void Save_EraseFile(int num) {
@@ -109,7 +107,7 @@ void Save_EraseFile(int num) {
     files[num] = NULL;
     char filename[20];
     snprintf(filename, sizeof(filename), "file%d.sav", num + 1);
-    remove(filename);
+    Writer_Remove(filename);
 }
 
 void Save_Init(void) {
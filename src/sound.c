@@ -32,11 +32,14 @@
 #include "sound.h"
 #include "util.h"
 
-// audio settings
-#define SOUND_FREQ 44100
-#define SAMPLES_PER_FRAME (SOUND_FREQ / 60)
 // how many frames of audio to store in the sound buffer (increase if your sound skips)
-#define BUFFERED_FRAMES 3
+#define BUFFERED_FRAMES 1
+// The display and audio device clocks never quite match, so the APU output
+// rate gets nudged by up to RATE_MAX_ADJUST to keep the number of samples
+// queued at the start of Sound_Run around half a frame's worth.
+#define RATE_MAX_ADJUST (0.005)
+// how many frames the fill level is averaged over
+#define RATE_AVERAGE_FRAMES (64)
 
 static const char *soundFilenames[NUM_SOUNDS] = {
     [MUS_TITLE]       = "mml/mus_title.mml",
@@ -75,6 +78,15 @@ static const char *soundFilenames[NUM_SOUNDS] = {
 };
 
 Sound sounds[NUM_SOUNDS];
+// Sounds get converted or compiled the first time they're played.
+static Uint8 soundLoaded[NUM_SOUNDS];
+// where each sound's definition starts in the ROM
+static Uint8 *romSounds[NUM_ROM_SOUNDS];
+// Sounds the prefetch thread is loading. Nothing else touches these entries
+// until the thread has been waited on.
+static Uint8 soundPrefetching[NUM_SOUNDS];
+static PlatformThread *prefetchThread = NULL;
+Arena soundArena = ARENA_INIT(ALLOC_TAG_SOUND, 64 * 1024);
 // where sound data is stored in CHR ROM
 #define CHR_ROM_SOUND (0x7B70)
 // where sound data is stored in PRG ROM
@@ -89,40 +101,124 @@ static Instrument savedMusInstruments[NUM_INSTRUMENTS];
 #define APU_CHANNELS 4
 static Uint8 channelsInUse[APU_CHANNELS * 2];
 static Uint8 apuStatusCopy[2];
+static int apuCount = 0;
+static int muted = 0;
+// nonzero = Sound_Play does nothing
+static int skipPlaying = 0;
 // 0-100
 static int volume = 50;
-static int muted;
+// set from the audio device's sample rate, so the output never needs resampling
+static int sampleRate;
+static int samplesPerFrame;
+static int targetFill;
+static double averageFill;
+static double rateAdjust = 0;
+static int lastFill;
 
 static void Sound_RunInstrument(int apu, Instrument *inst);
 static void Sound_DisableChannel(int apu, Uint8 channel);
 static void Sound_EnableChannel(int apu, Uint8 channel);
 
-static Uint8 *Sound_ConvertData(Uint8 *instData) {
-    Buffer *buf = Buffer_Init(16);
-    int pos = 0;
+static Uint16 freqTbl[] = {
+    0xd5c,
+    0xc9c,
+    0xbe8,
+    0xb3c,
+    0xa9a,
+    0xa02,
+    0x972,
+    0x8ea,
+    0x86a,
+    0x7f2,
+    0x780,
+    0x714,
+};
+
+SoundCmd *Sound_DecodeData(Arena *arena, Uint8 *records, int count, Uint8 channel) {
+    SoundCmd *out = Arena_Alloc(arena, count * sizeof(SoundCmd));
+    for (int i = 0; i < count; i++) {
+        Uint8 cmd = records[i * 3];
+        Uint16 param = Util_LoadUint16(records + (i * 3) + 1);
+        out[i].cmd = cmd;
+        out[i].param = param;
+        out[i].reg2 = 0;
+        out[i].reg3 = 0;
+        out[i].loopCount = 0;
+
+        if (cmd == 0xff) {
+            out[i].type = SOUND_CMD_END;
+        }
+        // a0-af: APU register setting
+        else if ((cmd >= 0xa0) && (cmd < 0xb0)) {
+            out[i].type = (cmd & 1) ? SOUND_CMD_REG1 : SOUND_CMD_REG0;
+        }
+        // b0-bf: looping/jumping
+        else if ((cmd >= 0xb0) && (cmd < 0xc0)) {
+            out[i].type = (cmd == 0xbf) ? SOUND_CMD_JUMP : SOUND_CMD_LOOP;
+            out[i].loopCount = cmd & 0xf;
+            // the engine doesn't check where it's jumping to, so it has to be
+            // checked here
+            if (param >= count) {
+                out[i].type = SOUND_CMD_END;
+            }
+        }
+        // >= c0 or < a0: play note
+        else {
+            // noise channel: set registers directly
+            if (channel == 3) {
+                out[i].type = SOUND_CMD_NOTE;
+                out[i].reg2 = cmd;
+            }
+            // key off
+            else if ((cmd & 0xf) >= 0xc) {
+                out[i].type = SOUND_CMD_KEY_OFF;
+                out[i].reg2 = 0x6f;
+            }
+            else {
+                Uint8 note = cmd & 0xf;
+                Uint8 octave = cmd >> 4;
+                Uint16 freq = freqTbl[note];
+                freq >>= (octave + 1);
+                out[i].type = SOUND_CMD_NOTE;
+                out[i].reg2 = freq & 0xff;
+                out[i].reg3 = freq >> 8;
+            }
+            // length counter load
+            out[i].reg3 |= 8;
+        }
+    }
+    return out;
+}
+
+static SoundCmd *Sound_ConvertData(Uint8 *instData, Uint8 channel) {
+    // find the end of the track first so the buffer only gets allocated once
+    int count = 0;
     while (1) {
-        // command: leave as is
-        Uint8 cmd = *instData++;
-        Buffer_Add(buf, cmd);
-        // parameter: convert to Uint16
-        Uint16 param = (Uint16)(*instData++);
-        Buffer_AddUint16(buf, param);
+        Uint8 cmd = instData[count * 2];
+        Uint8 param = instData[count * 2 + 1];
+        count++;
         // if we're jumping backwards or we hit the end of the track, exit the loop
-        if (((cmd == 0xbf) && (param < pos)) || (cmd == 0xff)) {
+        if (((cmd == 0xbf) && (param < count - 1)) || (cmd == 0xff)) {
             break;
         }
-        pos++;
     }
-    // Buffer_Destroy also frees buff->data, which we don't want to do
-    Uint8 *data = buf->data;
-    free(buf);
+
+    Buffer *buf = Buffer_Init(count * 3);
+    for (int i = 0; i < count; i++) {
+        // command: leave as is
+        Buffer_Add(buf, *instData++);
+        // parameter: convert to Uint16
+        Buffer_AddUint16(buf, (Uint16)(*instData++));
+    }
+    SoundCmd *data = Sound_DecodeData(&soundArena, buf->data, buf->dataSize / 3, channel);
+    Buffer_Destroy(buf);
     return data;
 }
 
-static Uint8 *Sound_LoadData(Uint8 *romData, Sound *out) {
+static void Sound_LoadData(Uint8 *romData, Sound *out) {
     int cursor = 0;
     out->count = romData[cursor++];
-    out->data = ommalloc(out->count * sizeof(Instrument));
+    out->data = Arena_Alloc(&soundArena, out->count * sizeof(Instrument));
     for (int i = 0; i < out->count; i++) {
         out->data[i].num = romData[cursor++];
         Uint16 addr = romData[cursor] | (romData[cursor + 1] << 8);
@@ -139,69 +235,149 @@ static Uint8 *Sound_LoadData(Uint8 *romData, Sound *out) {
             // PRG ROM is mapped into NES memory at 0x8000-0xFFFF
             instData = prgRom + (addr - 0x8000);
         }
-        out->data[i].data = Sound_ConvertData(instData);
         out->data[i].channel = romData[cursor++];
+        out->data[i].data = Sound_ConvertData(instData, out->data[i].channel);
         out->data[i].cursor = romData[cursor++];
         out->data[i].reg1 = romData[cursor++];
         out->data[i].reg0 = romData[cursor++];
         out->data[i].lastNote = 0;
     }
+}
 
-    return romData + cursor;
+static int Sound_LoadSound(int num) {
+    // override the sound with MML file if one is available
+    if (MML_Compile(soundFilenames[num], &sounds[num], &soundArena)) {
+        soundLoaded[num] = 1;
+        return 1;
+    }
+    // sounds that aren't in the ROM have to come from an MML file
+    if (num >= NUM_ROM_SOUNDS) {
+        return 0;
+    }
+    Sound_LoadData(romSounds[num], &sounds[num]);
+    // make sure you change this if you mess with the music order!
+    sounds[num].isMusic = ((num < SFX_PERASKULL) || (num == MUS_CASTLE));
+    // patch sound data to fix instrument allocation problems (why certain
+    // sound effects would cause issues with other sound effects, music
+    // channels dropping out, etc in the original game)
+    switch (num) {
+    case SFX_FIREBALL:
+        sounds[num].data[0].num = 5;
+        break;
+
+    case SFX_PAUSE:
+        sounds[num].data[0].num = 4;
+        break;
+
+    case SFX_SELECT:
+        sounds[num].data[0].num = 5;
+        sounds[num].data[1].num = 4;
+        break;
+    }
+    soundLoaded[num] = 1;
+    return 1;
 }
 
-int Sound_Init(void) {
-    Blargg_Apu_Init(SOUND_FREQ);
-    DBEntry *entry = DB_Find("volume");
-    if (entry) {
-        volume = (int)entry->data[0];
+static void Sound_WaitPrefetch(void) {
+    if (prefetchThread) {
+        Platform_WaitThread(prefetchThread);
+        prefetchThread = NULL;
     }
-    Blargg_Apu_Volume(volume);
-    muted = 0;
+    memset(soundPrefetching, 0, sizeof(soundPrefetching));
+}
 
-    // load sound data from the ROM
-    Uint8 *src = chrRom + CHR_ROM_SOUND;
-    for (int i = 0; i < NUM_ROM_SOUNDS; i++) {
-        // override the sound with MML file if one is available
-        if (MML_Compile(soundFilenames[i], &sounds[i])) {
-            // skip past the sound definition in the ROM
-            int count = (int)(*src++);
-            src += (count * 7);
+static Sound *Sound_Get(int num) {
+    if (soundPrefetching[num]) {
+        Sound_WaitPrefetch();
+    }
+    if (!soundLoaded[num]) {
+        // the prefetch thread is using the sound arena
+        Sound_WaitPrefetch();
+        Alloc_AllowBegin();
+        int loaded = Sound_LoadSound(num);
+        Alloc_AllowEnd();
+        if (!loaded) {
+            Platform_ShowError("Error compiling %s", soundFilenames[num]);
+            Platform_Quit();
         }
-        else {
-            src = Sound_LoadData(src, &sounds[i]);
-            // make sure you change this if you mess with the music order!
-            sounds[i].isMusic = ((i < SFX_PERASKULL) || (i == MUS_CASTLE));
-            // patch sound data to fix instrument allocation problems (why certain
-            // sound effects would cause issues with other sound effects, music
-            // channels dropping out, etc in the original game)
-            switch (i) {
-            case SFX_FIREBALL:
-                sounds[i].data[0].num = 5;
-                break;
+    }
+    return &sounds[num];
+}
 
-            case SFX_PAUSE:
-                sounds[i].data[0].num = 4;
-                break;
+static int Sound_PrefetchThread(void *data) {
+    (void)data;
+    for (int i = 0; i < NUM_SOUNDS; i++) {
+        // if this fails, the error gets shown when the sound gets played
+        if (soundPrefetching[i]) { Sound_LoadSound(i); }
+    }
+    return 1;
+}
 
-            case SFX_SELECT:
-                sounds[i].data[0].num = 5;
-                sounds[i].data[1].num = 4;
-                break;
-            }
+void Sound_Prefetch(const int *nums, int count) {
+    // the last batch should be done by now
+    Sound_WaitPrefetch();
+    int needed = 0;
+    for (int i = 0; i < count; i++) {
+        if (!soundLoaded[nums[i]]) {
+            soundPrefetching[nums[i]] = 1;
+            needed = 1;
         }
+    }
+    if (!needed) { return; }
+    prefetchThread = Platform_StartThread(Sound_PrefetchThread, NULL, "sound prefetch");
+    // without a thread, the sounds just get loaded when they're played
+    if (!prefetchThread) {
+        memset(soundPrefetching, 0, sizeof(soundPrefetching));
+    }
+}
+
+int Sound_LoadSounds(void) {
+    // find where each sound is stored in the ROM
+    Uint8 *src = chrRom + CHR_ROM_SOUND;
+    for (int i = 0; i < NUM_ROM_SOUNDS; i++) {
+        romSounds[i] = src;
+        int count = (int)(*src++);
+        src += (count * 7);
         // sound data stored in CHR ROM is padded for some reason
         if (i == 0) { src = chrRom + CHR_ROM_SOUND + 0x20; }
         // after loading title screen and ending music, switch to PRG ROM
         if (i == 1) { src = prgRom + PRG_ROM_SOUND; }
     }
-    for (int i = NUM_ROM_SOUNDS; i < NUM_SOUNDS; i++) {
-        // these sounds aren't in the ROM, so if the MML is missing or broken we have to abort
-        if (!MML_Compile(soundFilenames[i], &sounds[i])) {
-            Platform_ShowError("Error compiling %s", soundFilenames[i]);
-            Platform_Quit();
-        }
+    if (!Sound_LoadSound(MUS_TITLE)) { return 0; }
+    // Sounds that get played right away or all over the place. Loading these
+    // here means they never have to wait on a stage's prefetch batch. If one
+    // fails, the error gets shown when it's played.
+    static const int commonSounds[] = {
+        MUS_START,
+        SFX_MENU,
+        SFX_SELECT,
+        SFX_PAUSE,
+        SFX_JUMP,
+        SFX_SWORD,
+        SFX_LUCIA_HIT,
+        SFX_ENEMY_HIT,
+        SFX_ENEMY_KILL,
+        SFX_ITEM,
+    };
+    for (int i = 0; i < ARRAY_LEN(commonSounds); i++) {
+        Sound_LoadSound(commonSounds[i]);
     }
+    // everything else gets loaded the first time it's played or prefetched
+    return 1;
+}
+
+int Sound_Init(void) {
+    sampleRate = Platform_GetSampleRate();
+    samplesPerFrame = sampleRate / 60;
+    targetFill = samplesPerFrame / 2;
+    averageFill = targetFill;
+    Blargg_Apu_Init((Uint32)sampleRate);
+    DBEntry *entry = DB_Find("volume");
+    if (entry) {
+        volume = (int)entry->data[0];
+    }
+    Blargg_Apu_Volume(volume);
+    Platform_SetAudioCallback(Blargg_Apu_Render);
     return 1;
 }
 
@@ -221,17 +397,19 @@ int Sound_GetVolume(void) {
 
 void Sound_Mute(void) {
     muted = 1;
+    Blargg_Apu_SetMuted(1);
 }
 
 void Sound_Unmute(void) {
     muted = 0;
+    Blargg_Apu_SetMuted(0);
 }
 
 char *Sound_GetDebugText(int num) {
     static char output[256] = {0};
     char row[64];
     Instrument *insts;
-    if ((gameType != GAME_TYPE_ORIGINAL) && sounds[num].isMusic) {
+    if ((gameType != GAME_TYPE_ORIGINAL) && Sound_Get(num)->isMusic) {
         insts = musInstruments;
     }
     else {
@@ -267,11 +445,17 @@ void Sound_Reset(void) {
     Blargg_Apu_ClearBuffer();
 }
 
+void Sound_SetSkip(int skip) {
+    skipPlaying = skip;
+}
+
 void Sound_Play(int num) {
+    if (skipPlaying) { return; }
+    Sound *sound = Sound_Get(num);
     // copy all instruments from a sound into their respective slots
     Instrument *destInsts;
     int apu;
-    if ((gameType != GAME_TYPE_ORIGINAL) && sounds[num].isMusic) {
+    if ((gameType != GAME_TYPE_ORIGINAL) && sound->isMusic) {
         destInsts = musInstruments;
         apu = 1;
     }
@@ -279,8 +463,8 @@ void Sound_Play(int num) {
         destInsts = instruments;
         apu = 0;
     }
-    for (int i = 0; i < sounds[num].count; i++) {
-        Uint8 instNum = sounds[num].data[i].num;
+    for (int i = 0; i < sound->count; i++) {
+        Uint8 instNum = sound->data[i].num;
         // turn off the channel for the previous instrument in this slot
         // Note: The original game didn't do this, which is why sound effects
         // would sometimes stay on, etc.
@@ -288,7 +472,7 @@ void Sound_Play(int num) {
             Sound_DisableChannel(apu, destInsts[instNum].channel);
         }
         // load sound data into the slot
-        destInsts[instNum] = sounds[num].data[i];
+        destInsts[instNum] = sound->data[i];
         destInsts[instNum].timer = 1;
         destInsts[instNum].loop = 0xff;
         destInsts[instNum].ctrlRegsSet = 0xff;
@@ -318,45 +502,79 @@ static void Sound_RunEngine(void) {
     }
 }
 
-void Sound_Run(void) {
-    static Sint16 buff0[SAMPLES_PER_FRAME * BUFFERED_FRAMES];
-    static Sint16 buff1[SAMPLES_PER_FRAME * BUFFERED_FRAMES];
+static void Sound_UpdateRate(int fill) {
+    lastFill = fill;
+    averageFill += (fill - averageFill) / RATE_AVERAGE_FRAMES;
+    // proportional control: an empty queue gets the maximum speedup
+    double adjust = RATE_MAX_ADJUST * (targetFill - averageFill) / targetFill;
+    adjust = MAX(-RATE_MAX_ADJUST, MIN(adjust, RATE_MAX_ADJUST));
+    // changing the rate is cheap, but there's no point doing it every frame
+    double change = adjust - rateAdjust;
+    if ((change >= 0.00005) || (change <= -0.00005)) {
+        rateAdjust = adjust;
+        Blargg_Apu_SetRateAdjust(rateAdjust);
+    }
+}
 
-    // find the number of samples we need to fill up the audio buffer
-    Sint32 neededSamples = (SAMPLES_PER_FRAME * BUFFERED_FRAMES) - Platform_GetQueuedSamples();
+void Sound_GetStats(SoundStats *out) {
+    out->fill = lastFill;
+    out->averageFill = (int)averageFill;
+    out->targetFill = targetFill;
+    out->rateAdjustPpm = (int)(rateAdjust * 1000000);
+    out->underruns = Platform_GetAudioUnderruns();
+    Blargg_Apu_GetWriteStats(&out->apuWrites, &out->apuWritesSkipped);
+}
 
-    for (Sint32 i = 0; i < neededSamples; i += SAMPLES_PER_FRAME) {
-        Sound_RunEngine();
-        Blargg_Apu_EndFrame();
+void Sound_RunFrame(void) {
+    // the original game only has one APU, the other versions play music on a second one
+    int count = (gameType == GAME_TYPE_ORIGINAL) ? 1 : 2;
+    if (count != apuCount) {
+        apuCount = count;
+        Blargg_Apu_SetApuCount(apuCount);
     }
-    Blargg_Apu_Samples(0, buff0, SAMPLES_PER_FRAME * BUFFERED_FRAMES);
-    Sint32 outputSamples = Blargg_Apu_Samples(1, buff1, SAMPLES_PER_FRAME * BUFFERED_FRAMES);
-    if (muted) {
-        memset(buff0, 0, sizeof(buff0));
-    }
-    else {
-        // mix output from both APUs together
-        for (int i = 0; i < outputSamples; i++) {
-            buff0[i] += buff1[i];
+    Sound_RunEngine();
+    Blargg_Apu_EndFrame();
+}
+
+int Sound_ReadSamples(Sint16 *out, int count) {
+    return Blargg_Apu_Render(out, count);
+}
+
+int Sound_Playing(void) {
+    for (int i = 0; i < NUM_INSTRUMENTS; i++) {
+        if ((instruments[i].cursor != 0xffff) || (musInstruments[i].cursor != 0xffff)) {
+            return 1;
         }
     }
-    Platform_QueueSamples(buff0, outputSamples);
+    return 0;
 }
 
-static Uint16 freqTbl[] = {
-    0xd5c,
-    0xc9c,
-    0xbe8,
-    0xb3c,
-    0xa9a,
-    0xa02,
-    0x972,
-    0x8ea,
-    0x86a,
-    0x7f2,
-    0x780,
-    0x714,
-};
+int Sound_GetSampleRate(void) {
+    return sampleRate;
+}
+
+const char *Sound_GetFilename(int num) {
+    return soundFilenames[num];
+}
+
+void Sound_Run(void) {
+    // keep the engine going at one step per frame so the APU registers are
+    // right when sound comes back, but there's no queue to keep full
+    if (muted) {
+        Sound_RunFrame();
+        return;
+    }
+
+    // find the number of samples we need to fill up the audio buffer
+    int queued = Blargg_Apu_QueuedSamples();
+    Sound_UpdateRate(queued);
+    Sint32 neededSamples = (samplesPerFrame * BUFFERED_FRAMES) - queued;
+
+    // the audio thread turns these into samples as it needs them
+    for (Sint32 i = 0; i < neededSamples; i += samplesPerFrame) {
+        Sound_RunFrame();
+    }
+}
 
 static void Sound_RunInstrument(int apu, Instrument *inst) {
     Uint8 reg2, reg3;
@@ -371,85 +589,64 @@ static void Sound_RunInstrument(int apu, Instrument *inst) {
         reg2 = 0x6F;
     }
     else {
-        setReadPtr:;
-        Uint8 *read = inst->data + (inst->cursor * 3);
-        getCmd:
-        if (*read == 0xff) {
-            inst->cursor = 0xffff;
-            inst->loop = 0xff;
-            channelsInUse[(apu * APU_CHANNELS) + inst->channel] = 0;
-            Sound_DisableChannel(apu, inst->channel);
-            goto lostChannel;
-        }
-
-        Uint8 cmd = *read++;
-        Uint16 param = Util_LoadUint16(read);
-        read += 2;
+        SoundCmd *cmd;
+        while (1) {
+            cmd = &inst->data[inst->cursor];
+            switch (cmd->type) {
+            case SOUND_CMD_END:
+                inst->cursor = 0xffff;
+                inst->loop = 0xff;
+                channelsInUse[(apu * APU_CHANNELS) + inst->channel] = 0;
+                Sound_DisableChannel(apu, inst->channel);
+                goto lostChannel;
 
-        // a0-af: APU register setting
-        if ((cmd >= 0xa0) && (cmd < 0xb0)) {
-            if (cmd & 1) {
-                inst->reg1 = (Uint8)param;
-            }
-            else {
-                inst->reg0 = (Uint8)param;
-            }
-            inst->cursor++;
-            inst->ctrlRegsSet = 0xff;
-            goto getCmd;
-        }
-        // b0-bf: looping/jumping
-        else if ((cmd >= 0xb0) && (cmd < 0xc0)) {
-            if (cmd == 0xbf) {
-                inst->cursor = param;
-                goto setReadPtr;
-            }
-            // loop over: set to 0xff (no loop) and move on
-            if (!inst->loop) {
-                inst->loop--;
+            case SOUND_CMD_REG0:
+                inst->reg0 = (Uint8)cmd->param;
                 inst->cursor++;
-                goto getCmd;
-            }
-            // new loop
-            if (inst->loop == 0xff) {
-                inst->loop = cmd & 0xf;
-            }
-            // loop in progress
-            else {
-                inst->loop--;
-            }
-            inst->cursor = param;
-            goto setReadPtr;
-        }
-        // >= c0 or < a0: play note
-        else {
-            inst->cursor++;
+                inst->ctrlRegsSet = 0xff;
+                continue;
 
-            // noise channel: set registers directly
-            if (inst->channel == 3) {
-                reg2 = cmd;
-                reg3 = 0;
-            }
-            // key off
-            else if ((cmd & 0xf) >= 0xc) {
+            case SOUND_CMD_REG1:
+                inst->reg1 = (Uint8)cmd->param;
+                inst->cursor++;
+                inst->ctrlRegsSet = 0xff;
+                continue;
+
+            case SOUND_CMD_JUMP:
+                inst->cursor = cmd->param;
+                continue;
+
+            case SOUND_CMD_LOOP:
+                // loop over: set to 0xff (no loop) and move on
+                if (!inst->loop) {
+                    inst->loop--;
+                    inst->cursor++;
+                    continue;
+                }
+                // new loop
+                if (inst->loop == 0xff) {
+                    inst->loop = cmd->loopCount;
+                }
+                // loop in progress
+                else {
+                    inst->loop--;
+                }
+                inst->cursor = cmd->param;
+                continue;
+
+            case SOUND_CMD_KEY_OFF:
                 Sound_DisableChannel(apu, inst->channel);
-                reg2 = 0x6f;
-                reg3 = 0;
-            }
-            else {
-                Uint8 note = cmd & 0xf;
-                Uint8 octave = cmd >> 4;
-                Uint16 freq = freqTbl[note];
-                freq >>= (octave + 1);
-                reg2 = freq & 0xff;
-                reg3 = freq >> 8;
+                break;
             }
-
-            inst->lastNote = cmd;
-            inst->timer = param;
-            // length counter load
-            reg3 |= 8;
+            break;
         }
+
+        // key off or note
+        inst->cursor++;
+        reg2 = cmd->reg2;
+        reg3 = cmd->reg3;
+        inst->lastNote = cmd->cmd;
+        inst->timer = cmd->param;
     }
     // set up apu regs
     if (channelsInUse[(apu * APU_CHANNELS) + inst->channel]) {
@@ -18,6 +18,7 @@
  */
 
 #pragma once
+#include "alloc.h"
 
 typedef enum {
     MUS_TITLE       = 0,
@@ -57,10 +58,40 @@ typedef enum {
     NUM_SOUNDS,
 } SOUND_NUM;
 
+// Instrument data is stored as 3-byte {command, Uint16 parameter} records in
+// the ROM and MML output. It gets decoded into these when it's loaded so the
+// sound engine doesn't have to work anything out while it's running.
+typedef enum {
+    // play a note, reg2 and reg3 are the values to write to the APU
+    SOUND_CMD_NOTE,
+    // silence the channel
+    SOUND_CMD_KEY_OFF,
+    // set APU register 0 or 1 to param
+    SOUND_CMD_REG0,
+    SOUND_CMD_REG1,
+    // go to the command at param
+    SOUND_CMD_JUMP,
+    // go to the command at param loopCount times
+    SOUND_CMD_LOOP,
+    // stop the instrument
+    SOUND_CMD_END,
+} SOUND_CMD;
+
+typedef struct {
+    Uint8 type;
+    // the command byte it was decoded from
+    Uint8 cmd;
+    Uint8 reg2;
+    Uint8 reg3;
+    // note length, register value, or command number to go to
+    Uint16 param;
+    Uint8 loopCount;
+} SoundCmd;
+
 // state of a playing instrument
 typedef struct {
     Uint8 num;
-    Uint8 *data;
+    SoundCmd *data;
     Uint8 channel;
     Uint16 cursor;
     Uint8 reg0;
@@ -78,9 +109,55 @@ typedef struct {
 } Sound;
 
 extern Sound sounds[NUM_SOUNDS];
+// the game's sound data is allocated from here, only use it from one thread at a time
+extern Arena soundArena;
+
+typedef struct {
+    // samples that were queued when Sound_Run last started
+    int fill;
+    // running average of fill
+    int averageFill;
+    // the fill level the rate controller aims for
+    int targetFill;
+    // how much faster the audio is being output than normal, in parts per
+    // million (positive = more samples per frame)
+    int rateAdjustPpm;
+    // how many times the audio device ran out of samples
+    Uint32 underruns;
+    // APU register writes, and how many were skipped for not changing anything
+    Uint32 apuWrites;
+    Uint32 apuWritesSkipped;
+} SoundStats;
 
 /**
- * @brief Initializes sound output
+ * @brief Decodes instrument data into the format the sound engine uses.
+ * @param arena where to allocate the decoded data from
+ * @param records 3-byte {command, Uint16 parameter} records
+ * @param count number of records
+ * @param channel APU channel the instrument plays on
+ * @returns the decoded instrument data
+ */
+SoundCmd *Sound_DecodeData(Arena *arena, Uint8 *records, int count, Uint8 channel);
+
+/**
+ * @brief Finds the sounds in the ROM and loads the title theme, the stage
+ * start jingle and the common sound effects. Every other sound gets loaded
+ * the first time it's played or prefetched. Doesn't touch the platform
+ * layer, so it can be run on a worker thread during startup.
+ * @returns 1 on success, 0 on failure
+ */
+int Sound_LoadSounds(void);
+
+/**
+ * @brief Starts loading the given sounds in the background so they're ready
+ * by the time they get played.
+ * @param nums the sound numbers
+ * @param count how many sound numbers there are
+ */
+void Sound_Prefetch(const int *nums, int count);
+
+/**
+ * @brief Initializes sound output. Must be run after Sound_LoadSounds is done.
  * @returns 1 on success, 0 on failure
 */
 int Sound_Init(void);
@@ -98,7 +175,8 @@ int Sound_SetVolume(int vol);
 int Sound_GetVolume(void);
 
 /**
- * @brief Mutes the sound. Overrides any volume setting.
+ * @brief Mutes the sound. Overrides any volume setting. The sound engine keeps
+ * running, but no audio gets synthesized until it's unmuted.
  */
 void Sound_Mute(void);
 
@@ -119,6 +197,13 @@ char *Sound_GetDebugText(int num);
 */
 void Sound_Reset(void);
 
+/**
+ * @brief Enables or disables Sound_Play. Frames that are run more than once
+ * (netplay rollbacks) should only start their sounds the first time.
+ * @param skip nonzero = Sound_Play does nothing, zero = play sounds
+ */
+void Sound_SetSkip(int skip);
+
 /**
  * @brief Plays a sound number
  * @param num the sound to play
@@ -140,3 +225,42 @@ void Sound_LoadState(void);
  * you want audio playing
 */
 void Sound_Run(void);
+
+/**
+ * @brief Runs the sound engine for one frame and queues the APU output for it,
+ * without checking how much audio is already queued. Used for rendering audio
+ * faster than real time.
+ */
+void Sound_RunFrame(void);
+
+/**
+ * @brief Reads synthesized samples. Only for when there's no audio device
+ * reading them already.
+ * @param out where to write the samples to
+ * @param count maximum number of samples to read
+ * @returns number of samples read
+ */
+int Sound_ReadSamples(Sint16 *out, int count);
+
+/**
+ * @returns nonzero if any instruments are still playing
+ */
+int Sound_Playing(void);
+
+/**
+ * @returns the output sample rate in Hz
+ */
+int Sound_GetSampleRate(void);
+
+/**
+ * @param num sound number
+ * @returns the filename of the MML file for the given sound
+ */
+const char *Sound_GetFilename(int num);
+
+/**
+ * @brief Gets info about how full the audio output queue is and how much work
+ * the APUs are doing.
+ * @param out where to write the info to
+ */
+void Sound_GetStats(SoundStats *out);
@@ -0,0 +1,148 @@
+/* soundrender.c: Renders sounds to WAV files faster than real time
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "mml.h"
+#include "nanotime.h"
+#include "sound.h"
+#include "soundrender.h"
+#include "system.h"
+
+#define RENDER_CHUNK (1024)
+#define WAV_HEADER_SIZE (44)
+
+static void SoundRender_WriteUint16LE(Uint16 data, FILE *fp) {
+    fputc(data & 0xff, fp);
+    fputc(data >> 8, fp);
+}
+
+static void SoundRender_WriteUint32LE(Uint32 data, FILE *fp) {
+    fputc(data & 0xff, fp);
+    fputc((data >>  8) & 0xff, fp);
+    fputc((data >> 16) & 0xff, fp);
+    fputc((data >> 24) & 0xff, fp);
+}
+
+static void SoundRender_WriteHeader(FILE *fp, Uint32 samples) {
+    Uint32 rate = (Uint32)Sound_GetSampleRate();
+    Uint32 dataSize = samples * sizeof(Sint16);
+    fwrite("RIFF", 1, 4, fp);
+    SoundRender_WriteUint32LE(WAV_HEADER_SIZE - 8 + dataSize, fp);
+    fwrite("WAVE", 1, 4, fp);
+    fwrite("fmt ", 1, 4, fp);
+    SoundRender_WriteUint32LE(16, fp);
+    // PCM, mono
+    SoundRender_WriteUint16LE(1, fp);
+    SoundRender_WriteUint16LE(1, fp);
+    SoundRender_WriteUint32LE(rate, fp);
+    SoundRender_WriteUint32LE(rate * sizeof(Sint16), fp);
+    SoundRender_WriteUint16LE(sizeof(Sint16), fp);
+    SoundRender_WriteUint16LE(16, fp);
+    fwrite("data", 1, 4, fp);
+    SoundRender_WriteUint32LE(dataSize, fp);
+}
+
+// writes out everything that's been synthesized, returns the number of samples
+static Uint32 SoundRender_Flush(FILE *fp) {
+    Sint16 samples[RENDER_CHUNK];
+    Uint8 bytes[RENDER_CHUNK * sizeof(Sint16)];
+    Uint32 total = 0;
+    int count;
+    while ((count = Sound_ReadSamples(samples, RENDER_CHUNK)) > 0) {
+        for (int i = 0; i < count; i++) {
+            bytes[(i * 2) + 0] = (Uint8)(samples[i] & 0xff);
+            bytes[(i * 2) + 1] = (Uint8)((samples[i] >> 8) & 0xff);
+        }
+        fwrite(bytes, sizeof(Sint16), count, fp);
+        total += count;
+        if (count < RENDER_CHUNK) { break; }
+    }
+    return total;
+}
+
+static int SoundRender_Sound(int num, const char *filename, int seconds) {
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Couldn't open %s.\n", filename);
+        return 0;
+    }
+    // the header's sizes get filled in once the length is known
+    SoundRender_WriteHeader(fp, 0);
+    Sound_Reset();
+    Sound_Play(num);
+    Uint32 samples = 0;
+    int frames = seconds * 60;
+    for (int i = 0; (i < frames) && Sound_Playing(); i++) {
+        Sound_RunFrame();
+        samples += SoundRender_Flush(fp);
+    }
+    fseek(fp, 0, SEEK_SET);
+    SoundRender_WriteHeader(fp, samples);
+    fclose(fp);
+    printf("render: %s (%u samples)\n", filename, samples);
+    return 1;
+}
+
+static int SoundRender_All(const char *dir, int seconds) {
+    for (int i = 0; i < NUM_SOUNDS; i++) {
+        // name the WAV after the MML file
+        const char *mmlFilename = strrchr(Sound_GetFilename(i), '/');
+        mmlFilename = mmlFilename ? (mmlFilename + 1) : Sound_GetFilename(i);
+        char filename[512];
+        int len = (int)(strrchr(mmlFilename, '.') - mmlFilename);
+        snprintf(filename, sizeof(filename), "%s/%.*s.wav", dir, len, mmlFilename);
+        if (!SoundRender_Sound(i, filename, seconds)) { return 0; }
+    }
+    return 1;
+}
+
+int SoundRender_Run(const char *sound, const char *out, int seconds) {
+    if (seconds < 1) {
+        fprintf(stderr, "Length must be at least 1 second.\n");
+        return 0;
+    }
+    if (!System_InitHeadless()) { return 0; }
+    // headless runs are muted by default
+    Sound_Unmute();
+
+    uint64_t start = nanotime_now();
+    int ok;
+    if (strcmp(sound, "all") == 0) {
+        ok = SoundRender_All(out, seconds);
+    }
+    else if ((strlen(sound) > 0) && (strspn(sound, "0123456789") == strlen(sound))) {
+        int num = atoi(sound);
+        if (num >= NUM_SOUNDS) {
+            fprintf(stderr, "Sound number must be between 0-%d.\n", NUM_SOUNDS - 1);
+            return 0;
+        }
+        ok = SoundRender_Sound(num, out, seconds);
+    }
+    else {
+        // same as the standalone MML player, the file gets loaded into the first slot
+        if (!MML_Compile(sound, &sounds[0], &soundArena)) { return 0; }
+        ok = SoundRender_Sound(0, out, seconds);
+    }
+    printf("render: took %u ms\n", (Uint32)((nanotime_now() - start) / 1000000));
+    return ok;
+}
@@ -0,0 +1,33 @@
+/* soundrender.h: Renders sounds to WAV files faster than real time
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// how long to render looping sounds for if no length is given
+#define SOUNDRENDER_DEFAULT_SECONDS (30)
+
+/**
+ * @brief Initializes the engine headless and renders sounds to 16-bit mono WAV
+ * files. Each sound is rendered until it stops playing or hits the length limit.
+ * @param sound a sound number, an MML file, or "all" to render every sound
+ * @param out WAV file to write, or for "all", the directory to write them to
+ * @param seconds maximum length of each sound
+ * @returns zero on error
+ */
+int SoundRender_Run(const char *sound, const char *out, int seconds);
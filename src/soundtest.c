@@ -66,8 +66,17 @@ static MenuItem items[] = {
     MENU_TASK("Back", MainMenu_Run),
 };
 
+static void SoundTest_PrintStats(void) {
+    SoundStats stats;
+    Sound_GetStats(&stats);
+    BG_Print(3, 11, 0, "FILL %4d/%4d RATE %5d UR %u  ", stats.averageFill, stats.targetFill,
+             stats.rateAdjustPpm, stats.underruns);
+    BG_Print(3, 12, 0, "APU WRITES %u SKIPPED %u  ", stats.apuWrites, stats.apuWritesSkipped);
+}
+
 static void SoundTest_Draw(void) {
     BG_Print(11, 2, 0, "Sound Test");
+    SoundTest_PrintStats();
     BG_Print(3, 13, 0, "%s", Sound_GetDebugText(soundNum));
 }
 
@@ -80,7 +89,7 @@ void SoundTest_Run(void) {
 }
 
 int SoundTest_RunStandaloneInit(char *mmlPath) {
-    if (MML_Compile(mmlPath, &sounds[0])) {
+    if (MML_Compile(mmlPath, &sounds[0], &soundArena)) {
         BG_Clear();
         BG_SetAllPalettes(palette);
         BG_Print(8, 2, 0, "OpenMadoola MML");
@@ -112,6 +121,7 @@ void SoundTest_RunStandaloneTask(void) {
     Sound_Reset();
     Sound_Play(0);
     while (1) {
+        SoundTest_PrintStats();
         BG_Print(3, 13, 0, "%s", Sound_GetDebugText(soundNum));
         BG_Display();
         Task_Yield();
@@ -27,12 +27,20 @@
 #include "palette.h"
 #include "platform.h"
 #include "sprite.h"
+#include "state.h"
 
 #define MAX_SPRITES (200)
 static Sprite spriteList[MAX_SPRITES];
 
 static int addOrder = 0;
 
+void Sprite_RegisterState(void) {
+    // cleared entries keep their old contents, which depend on what ran before
+    // the game started (title screen, etc)
+    State_Register(spriteList, sizeof(spriteList), STATE_NOHASH);
+    State_Register(&addOrder, sizeof(addOrder), 0);
+}
+
 void Sprite_SetPalette(int palnum, Uint8 *palette) {
     memcpy(&colorPalette[(palnum + 4) * PALETTE_SIZE], palette, PALETTE_SIZE);
 }
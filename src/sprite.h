@@ -134,3 +134,8 @@ void Sprite_SetDrawLargeAbs(Sprite *s, Object *o, Uint16 *tiles, Sint8 *offsets)
  * @brief Draws all the sprites in the sprite list, should be run at the end of each frame
 */
 void Sprite_Display(void);
+
+/**
+ * @brief Adds the sprite list to the game state.
+*/
+void Sprite_RegisterState(void);
@@ -0,0 +1,163 @@
+/* state.c: Game state snapshots
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "bg.h"
+#include "camera.h"
+#include "constants.h"
+#include "darutos.h"
+#include "game.h"
+#include "hud.h"
+#include "item.h"
+#include "joy.h"
+#include "lucia.h"
+#include "map.h"
+#include "object.h"
+#include "palette.h"
+#include "rng.h"
+#include "sprite.h"
+#include "state.h"
+#include "task.h"
+#include "weapon.h"
+
+typedef struct {
+    Uint8 *data;
+    int size;
+    int flags;
+} StateRegion;
+
+typedef struct {
+    Uint8 **data;
+    int *size;
+} StateDynamicRegion;
+
+#define MAX_REGIONS 128
+static StateRegion regions[MAX_REGIONS];
+static int numRegions = 0;
+
+#define MAX_DYNAMIC_REGIONS 4
+static StateDynamicRegion dynamicRegions[MAX_DYNAMIC_REGIONS];
+static int numDynamicRegions = 0;
+
+static int initialized = 0;
+static int supported = 0;
+
+#define STATE_REGISTER(var, flags) State_Register(&(var), sizeof(var), flags)
+
+void State_Register(void *data, int size, int flags) {
+    assert(numRegions < MAX_REGIONS);
+    regions[numRegions].data = data;
+    regions[numRegions].size = size;
+    regions[numRegions].flags = flags;
+    numRegions++;
+}
+
+void State_RegisterDynamic(Uint8 **data, int *size) {
+    assert(numDynamicRegions < MAX_DYNAMIC_REGIONS);
+    dynamicRegions[numDynamicRegions].data = data;
+    dynamicRegions[numDynamicRegions].size = size;
+    numDynamicRegions++;
+}
+
+int State_Init(void) {
+    if (initialized) { return supported; }
+    initialized = 1;
+
+    // public variables get registered here, modules with private state
+    // register it themselves
+    STATE_REGISTER(cameraX, 0);
+    STATE_REGISTER(cameraY, 0);
+    STATE_REGISTER(scrollMode, 0);
+    STATE_REGISTER(darutosKilled, 0);
+    STATE_REGISTER(itemsCollected, 0);
+    STATE_REGISTER(joy, 0);
+    STATE_REGISTER(joyEdge, 0);
+    STATE_REGISTER(joyDir, 0);
+    // these come from the real controller even while a demo's playing
+    STATE_REGISTER(joyRaw, STATE_NOHASH);
+    STATE_REGISTER(joyEdgeRaw, STATE_NOHASH);
+    STATE_REGISTER(objects, 0);
+    STATE_REGISTER(currObjectIndex, 0);
+    STATE_REGISTER(colorPalette, 0);
+    STATE_REGISTER(flashTimer, 0);
+    STATE_REGISTER(rngVal, 0);
+    STATE_REGISTER(weaponLevels, 0);
+    STATE_REGISTER(currentWeapon, 0);
+    STATE_REGISTER(weaponDamage, 0);
+    STATE_REGISTER(weaponCoords, 0);
+
+    BG_RegisterState();
+    Game_RegisterState();
+    HUD_RegisterState();
+    Lucia_RegisterState();
+    Map_RegisterState();
+    Sprite_RegisterState();
+    supported = Task_RegisterState();
+    return supported;
+}
+
+void State_Save(Buffer *buf) {
+    assert(supported);
+    buf->dataSize = 0;
+    for (int i = 0; i < numRegions; i++) {
+        Buffer_AddData(buf, regions[i].data, regions[i].size);
+    }
+    for (int i = 0; i < numDynamicRegions; i++) {
+        Buffer_AddData(buf, *dynamicRegions[i].data, *dynamicRegions[i].size);
+    }
+}
+
+void State_Load(Buffer *buf) {
+    assert(supported);
+    Uint8 *cursor = buf->data;
+    for (int i = 0; i < numRegions; i++) {
+        memcpy(regions[i].data, cursor, regions[i].size);
+        cursor += regions[i].size;
+    }
+    // the dynamic regions' pointers and sizes were restored above
+    for (int i = 0; i < numDynamicRegions; i++) {
+        memcpy(*dynamicRegions[i].data, cursor, *dynamicRegions[i].size);
+        cursor += *dynamicRegions[i].size;
+    }
+    assert(cursor == (buf->data + buf->dataSize));
+}
+
+static Uint32 State_HashData(Uint32 hash, const Uint8 *data, int size) {
+    for (int i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+Uint32 State_Hash(Buffer *buf) {
+    Uint32 hash = 2166136261u;
+    // the fixed regions are at the same offsets in every snapshot
+    int offset = 0;
+    for (int i = 0; i < numRegions; i++) {
+        if (!(regions[i].flags & STATE_NOHASH)) {
+            Uint8 *data = buf ? (buf->data + offset) : regions[i].data;
+            hash = State_HashData(hash, data, regions[i].size);
+        }
+        offset += regions[i].size;
+    }
+    return hash;
+}
@@ -0,0 +1,73 @@
+/* state.h: Game state snapshots
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "buffer.h"
+#include "constants.h"
+
+// Snapshots are plain memory copies, so they're only valid within the process
+// that made them. Anything holding pointers or otherwise differing between two
+// machines running the same game (task stacks, pointers into ROM data) should
+// be registered with STATE_NOHASH so it doesn't get included in State_Hash.
+#define STATE_NOHASH (1 << 0)
+
+/**
+ * @brief Adds a fixed area of memory to the game state.
+ * @param data start of the memory
+ * @param size size of the memory in bytes
+ * @param flags STATE_NOHASH or 0
+ */
+void State_Register(void *data, int size, int flags);
+
+/**
+ * @brief Adds an area of memory whose location and size can change between
+ * snapshots to the game state. These get saved after all the fixed areas, so
+ * if the pointer and size are themselves registered with State_Register,
+ * loading a snapshot restores them before they're used. They're never hashed.
+ * @param data pointer to the start of the memory
+ * @param size pointer to the size of the memory in bytes
+ */
+void State_RegisterDynamic(Uint8 **data, int *size);
+
+/**
+ * @brief Registers all the gameplay state. Should be run after Task_Init.
+ * @returns nonzero on success, zero if snapshots aren't supported on this
+ * system
+ */
+int State_Init(void);
+
+/**
+ * @brief Saves the game state.
+ * @param buf where to save the state to. Its contents get replaced.
+ */
+void State_Save(Buffer *buf);
+
+/**
+ * @brief Restores the game state.
+ * @param buf a buffer written to by State_Save
+ */
+void State_Load(Buffer *buf);
+
+/**
+ * @brief Hashes the parts of the game state that are the same between two
+ * machines running the same game, for catching desyncs.
+ * @param buf snapshot to hash, or NULL to hash the current state
+ * @returns 32-bit FNV-1a hash of the state
+ */
+Uint32 State_Hash(Buffer *buf);
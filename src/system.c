@@ -18,10 +18,18 @@
  */
 
 #include <assert.h>
+#include <stdio.h>
+#include "alloc.h"
+#include "assetcache.h"
 #include "db.h"
+#include "demo.h"
+#include "file.h"
 #include "game.h"
+#include "graphics.h"
 #include "highscore.h"
 #include "joy.h"
+#include "nanotime.h"
+#include "netplay.h"
 #include "palette.h"
 #include "platform.h"
 #include "rng.h"
@@ -30,34 +38,166 @@
 #include "sound.h"
 #include "system.h"
 #include "task.h"
+#include "writer.h"
 
-int System_Init(void) {
-    // load assets
-    if (!Rom_Load())                    { return 0; }
-    if (!Rom_LoadChr("font.bin", 4096)) { return 0; }
+// seek distances for the demo viewer
+#define SEEK_SHORT (60 * 10)
+#define SEEK_LONG (60 * 60)
+
+static int demoSeeking = 0;
+static Uint32 seekButtonsLast = 0;
+// if nonzero, the ROM data came from the asset cache
+static int assetsCached = 0;
+
+static int System_InitAssets(void) {
+    File_Init();
+    Writer_Init();
+    // Rom_Load uses the db to remember where the ROM is in the Steam data
     DB_Init();
+    assetsCached = AssetCache_Load();
+    if (!assetsCached) {
+        if (!Rom_Load())                            { return 0; }
+        if (!Rom_LoadChr(FONT_FILENAME, FONT_SIZE)) { return 0; }
+    }
     Game_LoadSettings();
+    RNG_LoadSettings();
+    return 1;
+}
+
+// Startup work that only reads the ROM and asset files, so it can run on
+// worker threads while the platform layer is being initialized.
+typedef struct {
+    const char *name;
+    int (*func)(void);
+    PlatformThread *thread;
+    int result;
+} StartupJob;
 
-    // initialize platform code
-    if (!Platform_Init()) { return 0; }
+static StartupJob startupJobs[] = {
+    {"chr",   Graphics_Init},
+    {"sound", Sound_LoadSounds},
+    {"map",   Rom_PrefetchMapData},
+};
 
-    // initialize engine components
-    if (!Graphics_Init()) { return 0; }
+static int System_RunJob(void *data) {
+    StartupJob *job = (StartupJob *)data;
+    return job->func();
+}
+
+static void System_StartJobs(void) {
+    for (int i = 0; i < ARRAY_LEN(startupJobs); i++) {
+        StartupJob *job = &startupJobs[i];
+        job->thread = Platform_StartThread(System_RunJob, job, job->name);
+        // if we can't get a thread, just do the work here
+        if (!job->thread) {
+            job->result = job->func();
+        }
+    }
+}
+
+static int System_WaitJobs(void) {
+    int ok = 1;
+    for (int i = 0; i < ARRAY_LEN(startupJobs); i++) {
+        StartupJob *job = &startupJobs[i];
+        if (job->thread) {
+            job->result = Platform_WaitThread(job->thread);
+            job->thread = NULL;
+        }
+        if (!job->result) { ok = 0; }
+    }
+    return ok;
+}
+
+static int System_InitEngine(void) {
     if (!Sound_Init()) { return 0; }
     Save_Init();
     HighScore_Init();
     Joy_Init();
-    RNG_Seed();
+    RNG_Seed("startup");
     return 1;
 }
 
-void System_GameLoop(void) {
-    while (1) {
-        Platform_StartFrame();
+int System_Init(void) {
+    if (!System_InitAssets()) { return 0; }
+    System_StartJobs();
+    int platformOk = Platform_Init();
+    // always wait for the jobs so they aren't running while we shut down
+    int jobsOk = System_WaitJobs();
+    if (!platformOk || !jobsOk) { return 0; }
+    if (!assetsCached)          { AssetCache_Save(); }
+    if (!System_InitEngine())   { return 0; }
+    return 1;
+}
+
+int System_InitHeadless(void) {
+    if (!System_InitAssets()) { return 0; }
+    System_StartJobs();
+    if (!System_WaitJobs())   { return 0; }
+    if (!assetsCached)        { AssetCache_Save(); }
+    if (!System_InitEngine()) { return 0; }
+    // nobody's listening, so don't synthesize anything
+    Sound_Mute();
+    return 1;
+}
+
+void System_EnableDemoSeeking(void) {
+    demoSeeking = 1;
+}
+
+static void System_PrintDemoTime(Uint32 frame) {
+    Uint32 seconds = frame / 60;
+    Uint32 length = Demo_Length() / 60;
+    printf("demo: %02u:%02u / %02u:%02u\n", seconds / 60, seconds % 60, length / 60, length % 60);
+}
+
+static void System_DemoSeekControls(void) {
+    Uint32 buttons = Joy_ReadController();
+    Uint32 pressed = buttons & ~seekButtonsLast;
+    seekButtonsLast = buttons;
+    if (!Demo_Playing() || !Demo_Length()) { return; }
+
+    Sint32 offset = 0;
+    if (pressed & JOY_RIGHT) { offset = SEEK_SHORT; }
+    else if (pressed & JOY_LEFT) { offset = -SEEK_SHORT; }
+    else if (pressed & JOY_UP) { offset = SEEK_LONG; }
+    else if (pressed & JOY_DOWN) { offset = -SEEK_LONG; }
+    else if (pressed & JOY_SELECT) { System_PrintDemoTime(Demo_Frame()); }
+    if (!offset) { return; }
+
+    Sint32 target = (Sint32)Demo_Frame() + offset;
+    target = MAX(0, MIN(target, (Sint32)Demo_Length()));
+    uint64_t start = nanotime_now();
+    Demo_Seek((Uint32)target);
+    // run the frames between the keyframe and the target without drawing them
+    Graphics_SetSkip(1);
+    while (Demo_Playing() && (Demo_Frame() < (Uint32)target)) {
+        Demo_StartFrame();
         Graphics_StartFrame();
         Joy_Update();
         Task_Run();
+    }
+    Graphics_SetSkip(0);
+    Sound_Reset();
+    Game_PlayRoomSong();
+    System_PrintDemoTime(Demo_Frame());
+    printf("demo: seek took %u ms\n", (Uint32)((nanotime_now() - start) / 1000000));
+}
+
+void System_GameLoop(void) {
+    while (1) {
+        Platform_StartFrame();
+        if (Netplay_Active()) {
+            Netplay_Frame();
+        }
+        else {
+            if (demoSeeking) { System_DemoSeekControls(); }
+            Demo_StartFrame();
+            Graphics_StartFrame();
+            Joy_Update();
+            Task_Run();
+        }
         Sound_Run();
         Platform_EndFrame();
+        Alloc_EndFrame();
     }
 }
@@ -25,6 +25,19 @@
  */
 int System_Init(void);
 
+/**
+ * @brief Initializes the engine without the platform code (no window, audio
+ * device, etc). Nothing can be presented, but tasks can be run.
+ * @returns 0 on failure, nonzero on success
+ */
+int System_InitHeadless(void);
+
+/**
+ * @brief Lets the player seek through the demo being played back with the
+ * d-pad (left/right: 10 seconds, up/down: 1 minute, select: show the position).
+ */
+void System_EnableDemoSeeking(void);
+
 /**
  * @brief Runs platform code and jumps to the current task.
  */
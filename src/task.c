@@ -17,10 +17,12 @@
  * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
  */
 #include <assert.h>
+#include <stdint.h>
 #include "constants.h"
 #include "libco.h"
 #include "joy.h"
 #include "platform.h"
+#include "state.h"
 #include "task.h"
 
 static cothread_t systemTask;
@@ -37,6 +39,46 @@ static Uint8 gameStack[TASK_STACK_SIZE];
 static Uint8 childStack[TASK_STACK_SIZE];
 static int canDerive = 0;
 
+// libco keeps the suspended task's registers at the start of the stack memory
+#define TASK_CONTEXT_SIZE (512)
+// extra room below the deepest point seen when a task yields, covers what
+// co_switch pushes
+#define TASK_STACK_SLACK (256)
+// the part of each stack that's in use by a suspended task
+static Uint8 *gameStackLive;
+static int gameStackLiveSize;
+static Uint8 *childStackLive;
+static int childStackLiveSize;
+
+static void Task_SetLive(Uint8 *stack, Uint8 **live, int *liveSize, int size) {
+    if (size > (int)(TASK_STACK_SIZE - TASK_CONTEXT_SIZE)) {
+        size = (int)(TASK_STACK_SIZE - TASK_CONTEXT_SIZE);
+    }
+    *live = stack + TASK_STACK_SIZE - size;
+    *liveSize = size;
+}
+
+int Task_RegisterState(void) {
+    // when libco allocates the stacks itself there's no way to save them
+    if (!canDerive) { return 0; }
+    State_Register(&gameTask, sizeof(gameTask), STATE_NOHASH);
+    State_Register(&nextFunction, sizeof(nextFunction), STATE_NOHASH);
+    State_Register(&childTask, sizeof(childTask), STATE_NOHASH);
+    State_Register(&childTimer, sizeof(childTimer), 0);
+    State_Register(&childReturn, sizeof(childReturn), 0);
+    State_Register(&childSkippable, sizeof(childSkippable), 0);
+    State_Register(&childSkipped, sizeof(childSkipped), 0);
+    State_Register(&gameStackLive, sizeof(gameStackLive), STATE_NOHASH);
+    State_Register(&gameStackLiveSize, sizeof(gameStackLiveSize), STATE_NOHASH);
+    State_Register(&childStackLive, sizeof(childStackLive), STATE_NOHASH);
+    State_Register(&childStackLiveSize, sizeof(childStackLiveSize), STATE_NOHASH);
+    State_Register(gameStack, TASK_CONTEXT_SIZE, STATE_NOHASH);
+    State_Register(childStack, TASK_CONTEXT_SIZE, STATE_NOHASH);
+    State_RegisterDynamic(&gameStackLive, &gameStackLiveSize);
+    State_RegisterDynamic(&childStackLive, &childStackLiveSize);
+    return 1;
+}
+
 void Task_Init(void (*function)(void)) {
     systemTask = co_active();
     // some libco backends don't support using the provided memory instead of allocating new memory
@@ -52,11 +94,19 @@ void Task_Init(void (*function)(void)) {
     childReturn = 0;
     childSkippable = 0;
     childSkipped = 0;
+    Task_SetLive(gameStack, &gameStackLive, &gameStackLiveSize, TASK_STACK_SLACK);
+    Task_SetLive(childStack, &childStackLive, &childStackLiveSize, 0);
 }
 
 static void Task_SwitchCothreadFunction(cothread_t *cothread, Uint8 *stack, void (*function)(void)) {
     if (canDerive) {
         *cothread = co_derive(stack, TASK_STACK_SIZE, function);
+        if (stack == gameStack) {
+            Task_SetLive(gameStack, &gameStackLive, &gameStackLiveSize, TASK_STACK_SLACK);
+        }
+        else {
+            Task_SetLive(childStack, &childStackLive, &childStackLiveSize, TASK_STACK_SLACK);
+        }
     }
     else {
         if (*cothread) { co_delete(*cothread); }
@@ -66,6 +116,19 @@ static void Task_SwitchCothreadFunction(cothread_t *cothread, Uint8 *stack, void
 
 void Task_Yield(void) {
     assert(co_active() != systemTask);
+    // everything the task needs to resume is above this point on its stack
+    Uint8 marker;
+    if (!canDerive) {
+        // libco's stacks, nothing to keep track of
+    }
+    else if (co_active() == gameTask) {
+        int used = (int)(((uintptr_t)gameStack + TASK_STACK_SIZE) - (uintptr_t)&marker);
+        Task_SetLive(gameStack, &gameStackLive, &gameStackLiveSize, used + TASK_STACK_SLACK);
+    }
+    else {
+        int used = (int)(((uintptr_t)childStack + TASK_STACK_SIZE) - (uintptr_t)&marker);
+        Task_SetLive(childStack, &childStackLive, &childStackLiveSize, used + TASK_STACK_SLACK);
+    }
     co_switch(systemTask);
 }
 
@@ -100,6 +163,7 @@ static void Task_SwitchToParent(int skipped) {
         co_delete(childTask);
     }
     childTask = NULL;
+    Task_SetLive(childStack, &childStackLive, &childStackLiveSize, 0);
 }
 
 void Task_Run(void) {
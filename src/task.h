@@ -61,3 +61,10 @@ int Task_WasChildSkipped(void);
  * @brief Runs the current active task until it yields. Should be run once per frame.
  */
 void Task_Run(void);
+
+/**
+ * @brief Adds the task state (including the in-use part of the task stacks) to the game
+ * state. Should be run after Task_Init.
+ * @returns nonzero on success, zero if the libco backend doesn't let tasks be saved
+ */
+int Task_RegisterState(void);
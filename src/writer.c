@@ -0,0 +1,221 @@
+/* writer.c: Background file writer
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "file.h"
+#include "nanotime.h"
+#include "platform.h"
+#include "writer.h"
+
+#define MAX_JOBS (16)
+// long enough for MML cache files, which are named after the MML file's path
+#define MAX_NAME_LEN (512)
+// writes to the same file within this long of each other get merged together
+#define COALESCE_WINDOW (NANOTIME_NSEC_PER_SEC)
+#define NSEC_PER_MSEC (1000000)
+
+typedef enum {
+    JOB_WRITE,
+    JOB_REMOVE,
+    JOB_CLOSE,
+} JobType;
+
+typedef struct {
+    JobType type;
+    char name[MAX_NAME_LEN];
+    Uint8 *data;
+    int size;
+    FILE *fp;
+    // when the job should be run
+    uint64_t deadline;
+} WriterJob;
+
+static WriterJob jobs[MAX_JOBS];
+static int numJobs = 0;
+// set while the thread is running a job with the mutex unlocked
+static int busy = 0;
+// while nonzero, jobs get run right away instead of waiting for their deadline
+static int flushRequests = 0;
+static PlatformMutex *mutex = NULL;
+static PlatformCond *cond = NULL;
+static PlatformThread *thread = NULL;
+
+static void Writer_Run(WriterJob *job) {
+    switch (job->type) {
+    case JOB_WRITE:
+        if (!File_WriteAtomic(job->name, job->data, job->size)) {
+            printf("writer: couldn't write %s\n", job->name);
+        }
+        free(job->data);
+        break;
+
+    case JOB_REMOVE:
+        // not an error if the file was never there
+        File_Remove(job->name);
+        break;
+
+    case JOB_CLOSE:
+        File_Sync(job->fp);
+        fclose(job->fp);
+        break;
+    }
+}
+
+static int Writer_Thread(void *data) {
+    (void)data;
+    Platform_LockMutex(mutex);
+    while (1) {
+        if (!numJobs) {
+            Platform_WaitCond(cond, mutex, -1);
+            continue;
+        }
+
+        // jobs are kept in the order they were queued, so ties go to the oldest
+        int next = 0;
+        for (int i = 1; i < numJobs; i++) {
+            if (jobs[i].deadline < jobs[next].deadline) {
+                next = i;
+            }
+        }
+        uint64_t now = nanotime_now();
+        if (!flushRequests && (jobs[next].deadline > now)) {
+            int timeout = (int)((jobs[next].deadline - now) / NSEC_PER_MSEC) + 1;
+            Platform_WaitCond(cond, mutex, timeout);
+            continue;
+        }
+
+        WriterJob job = jobs[next];
+        numJobs--;
+        memmove(&jobs[next], &jobs[next + 1], (numJobs - next) * sizeof(WriterJob));
+        busy = 1;
+        Platform_UnlockMutex(mutex);
+        Writer_Run(&job);
+        Platform_LockMutex(mutex);
+        busy = 0;
+        Platform_BroadcastCond(cond);
+    }
+    return 0;
+}
+
+void Writer_Init(void) {
+    mutex = Platform_CreateMutex();
+    cond = Platform_CreateCond();
+    if (!mutex || !cond) { return; }
+    thread = Platform_StartThread(Writer_Thread, NULL, "writer");
+    // anything still queued up when main returns or exit gets called would
+    // otherwise be lost
+    if (thread) { atexit(Writer_Flush); }
+}
+
+static void Writer_Queue(WriterJob *job) {
+    if (!thread) {
+        Alloc_AllowBegin();
+        Writer_Run(job);
+        Alloc_AllowEnd();
+        return;
+    }
+
+    Platform_LockMutex(mutex);
+    // merge with a file that's already waiting to be written or removed
+    if (job->type != JOB_CLOSE) {
+        for (int i = 0; i < numJobs; i++) {
+            if ((jobs[i].type != JOB_CLOSE) && !strcmp(jobs[i].name, job->name)) {
+                if (jobs[i].type == JOB_WRITE) {
+                    free(jobs[i].data);
+                }
+                // keep the old deadline so constant writes still get saved
+                job->deadline = jobs[i].deadline;
+                jobs[i] = *job;
+                Platform_UnlockMutex(mutex);
+                return;
+            }
+        }
+    }
+
+    // make room by pushing out what's already queued up
+    if (numJobs == MAX_JOBS) {
+        flushRequests++;
+        Platform_BroadcastCond(cond);
+        while (numJobs == MAX_JOBS) {
+            Platform_WaitCond(cond, mutex, -1);
+        }
+        flushRequests--;
+    }
+    jobs[numJobs++] = *job;
+    Platform_BroadcastCond(cond);
+    Platform_UnlockMutex(mutex);
+}
+
+static int Writer_InitJob(WriterJob *job, JobType type, const char *filename) {
+    memset(job, 0, sizeof(WriterJob));
+    job->type = type;
+    if (filename) {
+        if (strlen(filename) >= MAX_NAME_LEN) {
+            printf("writer: filename %s too long\n", filename);
+            return 0;
+        }
+        strcpy(job->name, filename);
+    }
+    job->deadline = nanotime_now() + COALESCE_WINDOW;
+    return 1;
+}
+
+void Writer_Write(const char *filename, const Uint8 *data, int size) {
+    WriterJob job;
+    if (!Writer_InitJob(&job, JOB_WRITE, filename)) { return; }
+    // +1 so zero-length files don't turn into a zero-length allocation
+    Alloc_AllowBegin();
+    job.data = ommalloc(size + 1);
+    Alloc_AllowEnd();
+    memcpy(job.data, data, size);
+    job.size = size;
+    Writer_Queue(&job);
+}
+
+void Writer_Remove(const char *filename) {
+    WriterJob job;
+    if (!Writer_InitJob(&job, JOB_REMOVE, filename)) { return; }
+    Writer_Queue(&job);
+}
+
+void Writer_Close(FILE *fp) {
+    WriterJob job;
+    Writer_InitJob(&job, JOB_CLOSE, NULL);
+    job.fp = fp;
+    // nothing to merge with, so there's no point in waiting
+    job.deadline = nanotime_now();
+    Writer_Queue(&job);
+}
+
+void Writer_Flush(void) {
+    if (!thread) { return; }
+
+    Platform_LockMutex(mutex);
+    flushRequests++;
+    Platform_BroadcastCond(cond);
+    while (numJobs || busy) {
+        Platform_WaitCond(cond, mutex, -1);
+    }
+    flushRequests--;
+    Platform_UnlockMutex(mutex);
+}
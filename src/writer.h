@@ -0,0 +1,61 @@
+/* writer.h: Background file writer
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdio.h>
+#include "constants.h"
+
+// Everything the game saves (config, save files, demos, caches) goes through
+// here so the game thread never waits on the disk. Writes to the same file
+// that happen close together get merged into one, and every write replaces
+// the file atomically so a crash can't leave it half-written.
+
+/**
+ * @brief Starts the writer thread. If this isn't called (or the thread can't
+ * be started), everything gets written immediately instead. Whatever is still
+ * queued up at exit gets flushed.
+ */
+void Writer_Init(void);
+
+/**
+ * @brief Queues up a file to be written. If the file is already waiting to be
+ * written, the new contents replace the old ones.
+ * @param filename file to write (in the same directory File_Open uses)
+ * @param data what to write to it (copied, so it can be freed right away)
+ * @param size how many bytes to write
+ */
+void Writer_Write(const char *filename, const Uint8 *data, int size);
+
+/**
+ * @brief Queues up a file to be deleted.
+ * @param filename file to delete (in the same directory File_Open uses)
+ */
+void Writer_Remove(const char *filename);
+
+/**
+ * @brief Syncs and closes a file in the background. The writer owns the file
+ * after this is called.
+ * @param fp file to close
+ */
+void Writer_Close(FILE *fp);
+
+/**
+ * @brief Waits for everything that's been queued up to make it to the disk.
+ */
+void Writer_Flush(void);
@@ -0,0 +1,187 @@
+/* ompack.c: Builds resource archives for OpenMadoola
+ * Copyright (c) 2024 Nathan Misner
+ *
+ * This file is part of OpenMadoola.
+ *
+ * OpenMadoola is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * OpenMadoola is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with OpenMadoola. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// usage: ompack [-c] <archive> <file>...
+// Packs the given files into an archive (see archive.h for the format). File
+// names are stored as given, so run it from the directory the game would look
+// for the loose files in. With -c, files get LZ4 compressed if that makes them
+// smaller.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+#include "constants.h"
+#include "lz4.h"
+#include "util.h"
+
+typedef struct {
+    char *name;
+    Uint8 *data;
+    Uint32 storedSize;
+    Uint32 size;
+    Uint32 flags;
+} PackEntry;
+
+static void *Pack_Alloc(size_t size) {
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        fprintf(stderr, "ompack: out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static void Pack_Write32(FILE *fp, Uint32 num) {
+    Uint8 buf[4];
+    Util_SaveUint32(num, buf);
+    fwrite(buf, 1, sizeof(buf), fp);
+}
+
+static void Pack_Pad(FILE *fp, long *pos) {
+    while (*pos % ARCHIVE_ALIGN) {
+        fputc(0, fp);
+        (*pos)++;
+    }
+}
+
+static int Pack_CompareEntries(const void *a, const void *b) {
+    return strcmp(((const PackEntry *)a)->name, ((const PackEntry *)b)->name);
+}
+
+static int Pack_LoadEntry(const char *filename, int compress, PackEntry *out) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "ompack: couldn't open %s\n", filename);
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    Uint8 *data = Pack_Alloc(size);
+    if (fread(data, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "ompack: couldn't read %s\n", filename);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    // the game always uses '/' and never starts names with "./"
+    while (strncmp(filename, "./", 2) == 0) { filename += 2; }
+    out->name = Pack_Alloc(strlen(filename) + 1);
+    strcpy(out->name, filename);
+    for (char *c = out->name; *c; c++) {
+        if (*c == '\\') { *c = '/'; }
+    }
+    out->data = data;
+    out->size = (Uint32)size;
+    out->storedSize = (Uint32)size;
+    out->flags = 0;
+
+    if (compress && size) {
+        Uint8 *packed = Pack_Alloc(size);
+        // only worth it if it saves something
+        int packedSize = Lz4_Compress(data, (int)size, packed, (int)size - 1);
+        if (packedSize) {
+            free(data);
+            out->data = packed;
+            out->storedSize = (Uint32)packedSize;
+            out->flags |= ARCHIVE_FLAG_LZ4;
+        }
+        else {
+            free(packed);
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int compress = 0;
+    int arg = 1;
+    if ((arg < argc) && (strcmp(argv[arg], "-c") == 0)) {
+        compress = 1;
+        arg++;
+    }
+    if ((argc - arg) < 2) {
+        fprintf(stderr, "usage: ompack [-c] <archive> <file>...\n");
+        return 1;
+    }
+    const char *outName = argv[arg++];
+    int numEntries = argc - arg;
+    PackEntry *entries = Pack_Alloc(numEntries * sizeof(PackEntry));
+    for (int i = 0; i < numEntries; i++) {
+        if (!Pack_LoadEntry(argv[arg + i], compress, &entries[i])) { return 1; }
+    }
+    // the game uses a binary search to find entries
+    qsort(entries, numEntries, sizeof(PackEntry), Pack_CompareEntries);
+    for (int i = 1; i < numEntries; i++) {
+        if (strcmp(entries[i - 1].name, entries[i].name) == 0) {
+            fprintf(stderr, "ompack: %s was given twice\n", entries[i].name);
+            return 1;
+        }
+    }
+
+    // names go right after the entry table, then the data
+    Uint32 *nameOffsets = Pack_Alloc(numEntries * sizeof(Uint32));
+    Uint32 *dataOffsets = Pack_Alloc(numEntries * sizeof(Uint32));
+    Uint32 pos = ARCHIVE_HEADER_SIZE + (numEntries * ARCHIVE_ENTRY_SIZE);
+    for (int i = 0; i < numEntries; i++) {
+        nameOffsets[i] = pos;
+        pos += (Uint32)strlen(entries[i].name) + 1;
+    }
+    for (int i = 0; i < numEntries; i++) {
+        pos = (pos + ARCHIVE_ALIGN - 1) & ~(ARCHIVE_ALIGN - 1);
+        dataOffsets[i] = pos;
+        pos += entries[i].storedSize;
+    }
+
+    FILE *fp = fopen(outName, "wb");
+    if (!fp) {
+        fprintf(stderr, "ompack: couldn't open %s for writing\n", outName);
+        return 1;
+    }
+    fwrite(ARCHIVE_MAGIC, 1, 4, fp);
+    Pack_Write32(fp, ARCHIVE_VERSION);
+    Pack_Write32(fp, (Uint32)numEntries);
+    for (int i = 0; i < numEntries; i++) {
+        Pack_Write32(fp, nameOffsets[i]);
+        Pack_Write32(fp, dataOffsets[i]);
+        Pack_Write32(fp, entries[i].storedSize);
+        Pack_Write32(fp, entries[i].size);
+        Pack_Write32(fp, entries[i].flags);
+    }
+    long filePos = ARCHIVE_HEADER_SIZE + (numEntries * ARCHIVE_ENTRY_SIZE);
+    for (int i = 0; i < numEntries; i++) {
+        size_t len = strlen(entries[i].name) + 1;
+        fwrite(entries[i].name, 1, len, fp);
+        filePos += (long)len;
+    }
+    for (int i = 0; i < numEntries; i++) {
+        Pack_Pad(fp, &filePos);
+        fwrite(entries[i].data, 1, entries[i].storedSize, fp);
+        filePos += entries[i].storedSize;
+        printf("%s: %u -> %u bytes\n", entries[i].name, entries[i].size, entries[i].storedSize);
+    }
+    if (fclose(fp)) {
+        fprintf(stderr, "ompack: error writing %s\n", outName);
+        return 1;
+    }
+    return 0;
+}